@@ -1,7 +1,61 @@
+#define _CRT_SECURE_NO_WARNINGS
 #include "raylib.h"
 #include <cmath>
 #include <vector>
 #include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+// raylib and windows.h both define Rectangle/CloseWindow/DrawText etc, so keep the Win32 headers lean
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#define NOUSER
+#define NOMMSYSTEM
+#include <winsock2.h>
+#include <windows.h>
+#include <afunix.h>
+#include <dbghelp.h>
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "dbghelp.lib")
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#if defined(__linux__)
+#include <ucontext.h>
+#endif
+#include <cerrno>
+extern char** environ;
+#endif
+#include "state_feed.h"
 
 // ---------- Basic vector helpers ----------
 static float Length(const Vector2& v) { return sqrtf(v.x * v.x + v.y * v.y); }
@@ -23,6 +77,79 @@ static Vector2 Limit(const Vector2& v, float max) {
 static const float PI = 3.14159265358979323846f;
 #endif
 
+// ---------- Counter-based random numbers ----------
+// Philox4x32-10: a pure function of (key, counter), so any agent's random numbers for any step can be drawn on
+// any thread in any order. Keyed by the run seed, counter = (agent id, step, stream).
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STEER_SSE2 1
+#endif
+
+struct Random4 { uint32_t v[4]; };
+
+static const uint32_t PHILOX_M0 = 0xD2511F53u, PHILOX_M1 = 0xCD9E8D57u;
+static const uint32_t PHILOX_W0 = 0x9E3779B9u, PHILOX_W1 = 0xBB67AE85u;
+
+static Random4 Philox4x32(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint64_t key) {
+    uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+    for (int round = 0; round < 10; ++round) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0; c1 = (uint32_t)p1; c2 = n2; c3 = (uint32_t)p0;
+        k0 += PHILOX_W0; k1 += PHILOX_W1;
+    }
+    Random4 r = { { c0, c1, c2, c3 } };
+    return r;
+}
+
+// Four random words for (agent, step, stream); different streams give independent draws within one step
+static Random4 AgentRandom(uint64_t seed, uint32_t agentId, uint64_t step, uint32_t stream = 0) {
+    return Philox4x32(agentId, (uint32_t)step, (uint32_t)(step >> 32), stream, seed);
+}
+
+static const uint32_t PLAYER_AGENT_ID = 0xFFFFFFFFu; // the Task1 single agent
+
+static float RandomUnit(uint32_t r) { return (float)(r >> 8) * (1.0f / 16777216.0f); } // [0,1)
+
+// AgentRandom for agents firstAgent .. firstAgent+count-1 at once; out[i] == AgentRandom(seed, firstAgent + i, step, stream)
+static void AgentRandomBatch(uint64_t seed, uint32_t firstAgent, size_t count, uint64_t step, uint32_t stream, Random4* out) {
+    size_t i = 0;
+#if defined(STEER_SSE2)
+    // four agents per iteration, one agent per lane; _mm_mul_epu32 gives the 32x32->64 products of lanes 0 and 2
+    const __m128i m0 = _mm_set1_epi32((int)PHILOX_M0), m1 = _mm_set1_epi32((int)PHILOX_M1);
+    const __m128i lo32 = _mm_set1_epi64x(0xFFFFFFFFll);
+    for (; i + 4 <= count; i += 4) {
+        __m128i c0 = _mm_add_epi32(_mm_set1_epi32((int)(firstAgent + (uint32_t)i)), _mm_setr_epi32(0, 1, 2, 3));
+        __m128i c1 = _mm_set1_epi32((int)(uint32_t)step);
+        __m128i c2 = _mm_set1_epi32((int)(uint32_t)(step >> 32));
+        __m128i c3 = _mm_set1_epi32((int)stream);
+        uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+        for (int round = 0; round < 10; ++round) {
+            __m128i e0 = _mm_mul_epu32(c0, m0), o0 = _mm_mul_epu32(_mm_srli_epi64(c0, 32), m0);
+            __m128i e1 = _mm_mul_epu32(c2, m1), o1 = _mm_mul_epu32(_mm_srli_epi64(c2, 32), m1);
+            __m128i lo0 = _mm_or_si128(_mm_and_si128(e0, lo32), _mm_slli_epi64(o0, 32));
+            __m128i hi0 = _mm_or_si128(_mm_srli_epi64(e0, 32), _mm_andnot_si128(lo32, o0));
+            __m128i lo1 = _mm_or_si128(_mm_and_si128(e1, lo32), _mm_slli_epi64(o1, 32));
+            __m128i hi1 = _mm_or_si128(_mm_srli_epi64(e1, 32), _mm_andnot_si128(lo32, o1));
+            __m128i n0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+            __m128i n2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+            c0 = n0; c1 = lo1; c2 = n2; c3 = lo0;
+            k0 += PHILOX_W0; k1 += PHILOX_W1;
+        }
+        // lanes -> per-agent Random4 (4x4 transpose)
+        __m128i t0 = _mm_unpacklo_epi32(c0, c1), t1 = _mm_unpacklo_epi32(c2, c3);
+        __m128i t2 = _mm_unpackhi_epi32(c0, c1), t3 = _mm_unpackhi_epi32(c2, c3);
+        _mm_storeu_si128((__m128i*)&out[i + 0], _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*)&out[i + 1], _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*)&out[i + 2], _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i*)&out[i + 3], _mm_unpackhi_epi64(t2, t3));
+    }
+#endif
+    for (; i < count; ++i) out[i] = AgentRandom(seed, firstAgent + (uint32_t)i, step, stream);
+}
+
 // ---------- Single-agent behaviors (Task 1) ----------
 Vector2 Seek(const Vector2& pos, const Vector2& target, float maxSpeed) {
     Vector2 desired = Sub(target, pos);
@@ -57,7 +184,8 @@ Vector2 Arrive(const Vector2& pos, const Vector2& target, float maxSpeed, float
     if (speed > maxSpeed) speed = maxSpeed;
     return Scale(desired, speed);
 }
-Vector2 Wander(const Vector2& position, const Vector2& velocity, float maxSpeed, float& wanderAngle) {
+// `random` is one draw from AgentRandom, so Wander itself holds no hidden RNG state
+Vector2 Wander(const Vector2& position, const Vector2& velocity, float maxSpeed, float& wanderAngle, uint32_t random) {
     float circleDistance = 50;
     float circleRadius = 30;
     float angleChange = 0.5f;
@@ -67,7 +195,7 @@ Vector2 Wander(const Vector2& position, const Vector2& velocity, float maxSpeed,
     circleCenter = Scale(circleCenter, circleDistance);
 
     // random change
-    wanderAngle += ((float)GetRandomValue(-100, 100) / 100.0f) * angleChange;
+    wanderAngle += ((float)((int)(random % 201) - 100) / 100.0f) * angleChange;
 
     Vector2 displacement = { cosf(wanderAngle) * circleRadius, sinf(wanderAngle) * circleRadius };
     Vector2 wanderForce = Add(circleCenter, displacement);
@@ -176,10 +304,15 @@ Vector2 PathFollowing(const Agent& a, const std::vector<Vector2>& path, int& out
 }
 
 // ---------- Task3: Combining behaviors ----------
-Vector2 PrioritySteering(const std::vector<Vector2>& forces, float epsilon = 0.001f) {
-    for (const Vector2& f : forces) {
-        if (Length(f) > epsilon) return f;
+// `chosen` (optional) receives the index of the winning force, forces.size() if none is above epsilon
+Vector2 PrioritySteering(const std::vector<Vector2>& forces, float epsilon = 0.001f, size_t* chosen = nullptr) {
+    for (size_t i = 0; i < forces.size(); ++i) {
+        if (Length(forces[i]) > epsilon) {
+            if (chosen) *chosen = i;
+            return forces[i];
+        }
     }
+    if (chosen) *chosen = forces.size();
     return { 0,0 };
 }
 Vector2 WeightedBlend(const std::vector<std::pair<Vector2, float>>& forces, float maxForce) {
@@ -190,285 +323,4729 @@ Vector2 WeightedBlend(const std::vector<std::pair<Vector2, float>>& forces, floa
     return Limit(total, maxForce);
 }
 
-// ---------- Drawing helpers ----------
-void DrawAgentTriangle(const Vector2& pos, const Vector2& vel, Color color) {
-    // Robust triangle draw:
-    // - If velocity is near zero, pick a default heading (right)
-    // - Larger triangle (so it's visible on big screens)
-    // - Draw filled triangle + outline
+// ---------- Timing ----------
+// raylib's GetTime() needs a window, this also works headless and before InitWindow
+static double NowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-    float heading;
-    if (Length(vel) < 0.01f) {
-        // default facing right (so it is visible even if agent is stationary)
-        heading = 0.0f;
-    }
-    else {
-        heading = atan2f(vel.y, vel.x);
+// ---------- Memory-mapped files ----------
+struct MappedFile {
+    void* data = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Read-only mapping of a whole file
+bool MapFile(const char* fileName, MappedFile& out) {
+    out = MappedFile();
+#if defined(_WIN32)
+    out.file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (out.file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(out.file, &sz) || sz.QuadPart == 0) { CloseHandle(out.file); out.file = INVALID_HANDLE_VALUE; return false; }
+    out.size = (size_t)sz.QuadPart;
+    out.mapping = CreateFileMappingA(out.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (out.mapping) out.data = MapViewOfFile(out.mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!out.data) {
+        if (out.mapping) CloseHandle(out.mapping);
+        CloseHandle(out.file);
+        out = MappedFile();
+        return false;
     }
+#else
+    out.fd = open(fileName, O_RDONLY);
+    if (out.fd < 0) return false;
+    struct stat st;
+    if (fstat(out.fd, &st) != 0 || st.st_size == 0) { close(out.fd); out.fd = -1; return false; }
+    out.size = (size_t)st.st_size;
+    void* p = mmap(nullptr, out.size, PROT_READ, MAP_PRIVATE, out.fd, 0);
+    if (p == MAP_FAILED) { close(out.fd); out = MappedFile(); return false; }
+    out.data = p;
+#endif
+    return true;
+}
 
-    // triangle size
-    float forward = 20.0f;      // length from center to tip
-    float halfBase = 12.0f;     // half of base width
+void UnmapFile(MappedFile& m) {
+#if defined(_WIN32)
+    if (m.data) UnmapViewOfFile(m.data);
+    if (m.mapping) CloseHandle(m.mapping);
+    if (m.file != INVALID_HANDLE_VALUE) CloseHandle(m.file);
+#else
+    if (m.data) munmap(m.data, m.size);
+    if (m.fd >= 0) close(m.fd);
+#endif
+    m = MappedFile();
+}
 
-    // define local points (pointing toward +X)
-    Vector2 p1 = { forward, 0 };                 // tip
-    Vector2 p2 = { -halfBase, halfBase * 0.7f }; // bottom-left
-    Vector2 p3 = { -halfBase, -halfBase * 0.7f };// top-left
+// ---------- World snapshots ----------
+// File layout (little endian, every section starts on a 64 byte boundary):
+//   SnapshotHeader | Agent[agentCount] | Vector2 path[pathCount] | Vector2 obsCenters[obsCount] | float obsRadii[obsCount]
+//   | SnapshotRunState | uint8_t pursuitTeam[pursuitCount] | uint32_t pursuitTarget[pursuitCount]
+// Agent records are stored exactly as they sit in memory, so a load is one bulk copy per array out of the mapping.
+// Besides the world, a snapshot holds the state the next step reads back: the Task1 player with its wander angle
+// and step counter, and the pursuit teams with their cached targets. It does not hold the settings and toggles,
+// the load shedder's level and steering caches, the grid tuner's scale or the ECS wanderers; a load keeps the
+// current settings, drops the caches and the wanderers, and from there the crowd steps exactly as it did after the
+// save as long as the settings match and no steering quality is shed.
+static_assert(std::is_trivially_copyable<Agent>::value, "Agent must stay POD to be snapshotted");
 
-    // rotation matrix
-    float s = sinf(heading), c = cosf(heading);
-    auto rot = [&](const Vector2& p) {
-        return Vector2{ pos.x + (p.x * c - p.y * s), pos.y + (p.x * s + p.y * c) };
-        };
+static const char SNAPSHOT_MAGIC[8] = { 'S','T','E','E','R','S','N','P' };
+static const uint32_t SNAPSHOT_VERSION = 2;
+static const uint64_t SNAPSHOT_ALIGN = 64;
 
-    Vector2 r1 = rot(p1), r2 = rot(p2), r3 = rot(p3);
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t agentStride;   // sizeof(Agent) of the writer, rejected on mismatch
+    uint32_t reserved;
+    uint64_t step;
+    uint64_t fileSize;
+    uint64_t agentCount, agentOffset;
+    uint64_t pathCount, pathOffset;
+    uint64_t obsCount, obsCenterOffset, obsRadiusOffset;
+    uint64_t runStateOffset;
+    uint64_t pursuitCount, pursuitTeamOffset, pursuitTargetOffset;
+};
 
-    // Draw filled + outline for better visibility
-    DrawTriangle(r1, r2, r3, color);
-    DrawTriangleLines(r1, r2, r3, BLACK);
+// Per-run state outside the agent vector
+struct SnapshotRunState {
+    Agent player;
+    float wanderAngle;
+    uint32_t reserved;
+    uint64_t singleStep;
+};
+
+static uint64_t AlignUp(uint64_t v, uint64_t a) { return (v + a - 1) / a * a; }
+
+static bool WriteSection(FILE* f, uint64_t offset, const void* data, size_t bytes) {
+    static const char zeros[SNAPSHOT_ALIGN] = {};
+    long pos = ftell(f);
+    if (pos < 0 || (uint64_t)pos > offset) return false;
+    if (offset > (uint64_t)pos && fwrite(zeros, 1, (size_t)(offset - (uint64_t)pos), f) != offset - (uint64_t)pos) return false;
+    return bytes == 0 || fwrite(data, 1, bytes, f) == bytes;
 }
 
-// ---------- Main ----------
-int main() {
-    const int screenW = 1800, screenH = 1000;
-    InitWindow(screenW, screenH, "Steering Behaviors Assignment - Fixed");
-    SetTargetFPS(60);
+// `pursuitTeam` and `pursuitTarget` must have the same length (PursuitTeams::team/target)
+bool SaveSnapshot(const char* fileName, uint64_t step, const std::vector<Agent>& agents, const std::vector<Vector2>& path,
+    const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii, const SnapshotRunState& run,
+    const std::vector<uint8_t>& pursuitTeam, const std::vector<uint32_t>& pursuitTarget) {
+    if (pursuitTeam.size() != pursuitTarget.size()) return false;
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.headerSize = sizeof(SnapshotHeader);
+    h.agentStride = sizeof(Agent);
+    h.step = step;
+    h.agentCount = agents.size();
+    h.pathCount = path.size();
+    h.obsCount = obsCenters.size();
+    h.pursuitCount = pursuitTeam.size();
+    h.agentOffset = AlignUp(sizeof(SnapshotHeader), SNAPSHOT_ALIGN);
+    h.pathOffset = AlignUp(h.agentOffset + h.agentCount * sizeof(Agent), SNAPSHOT_ALIGN);
+    h.obsCenterOffset = AlignUp(h.pathOffset + h.pathCount * sizeof(Vector2), SNAPSHOT_ALIGN);
+    h.obsRadiusOffset = AlignUp(h.obsCenterOffset + h.obsCount * sizeof(Vector2), SNAPSHOT_ALIGN);
+    h.runStateOffset = AlignUp(h.obsRadiusOffset + h.obsCount * sizeof(float), SNAPSHOT_ALIGN);
+    h.pursuitTeamOffset = AlignUp(h.runStateOffset + sizeof(SnapshotRunState), SNAPSHOT_ALIGN);
+    h.pursuitTargetOffset = AlignUp(h.pursuitTeamOffset + h.pursuitCount * sizeof(uint8_t), SNAPSHOT_ALIGN);
+    h.fileSize = AlignUp(h.pursuitTargetOffset + h.pursuitCount * sizeof(uint32_t), SNAPSHOT_ALIGN);
 
-    // --- Task1 single-agent setup ---
-    Agent player;
-    player.pos = { 500,400 };
-    // *** small non-zero initial velocity so heading is defined immediately ***
-    player.vel = { 0.05f, 0.0f };
-    player.acc = { 0,0 };
-    player.maxSpeed = 3.0f;
-    player.maxForce = 0.12f;
-    float wanderAngle = 0.0f;
-    Vector2 target = { 700,500 };
-    int singleMode = 1; // 1=Seek 2=Flee 3=Pursue 4=Evade 5=Arrive 6=Wander
-    Vector2 mousePrev = GetMousePosition();
-    Vector2 mouseVel = { 0,0 };
+    // write to a temp file first so a crash mid-save never leaves a torn snapshot behind
+    std::string tmpName = std::string(fileName) + ".tmp";
+    FILE* f = fopen(tmpName.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && WriteSection(f, h.agentOffset, agents.data(), agents.size() * sizeof(Agent))
+        && WriteSection(f, h.pathOffset, path.data(), path.size() * sizeof(Vector2))
+        && WriteSection(f, h.obsCenterOffset, obsCenters.data(), obsCenters.size() * sizeof(Vector2))
+        && WriteSection(f, h.obsRadiusOffset, obsRadii.data(), obsRadii.size() * sizeof(float))
+        && WriteSection(f, h.runStateOffset, &run, sizeof(run))
+        && WriteSection(f, h.pursuitTeamOffset, pursuitTeam.data(), pursuitTeam.size() * sizeof(uint8_t))
+        && WriteSection(f, h.pursuitTargetOffset, pursuitTarget.data(), pursuitTarget.size() * sizeof(uint32_t))
+        && WriteSection(f, h.fileSize, nullptr, 0);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) { remove(tmpName.c_str()); return false; }
+    remove(fileName);
+    return rename(tmpName.c_str(), fileName) == 0;
+}
 
-    // --- Task2 multi-agent setup ---
-    std::vector<Vector2> path = {
-        {150,120}, {400,90}, {800,150}, {920,300},
-        {800,520}, {520,620}, {240,500}, {100,350}
-    };
-    std::vector<Vector2> obsCenters = { {500,320}, {300,380}, {700,460} };
-    std::vector<float> obsRadii = { 60.0f, 45.0f, 55.0f };
+// Restores everything SaveSnapshot wrote. The header is validated before anything is touched, so on failure
+// the live state is left as it was.
+bool LoadSnapshot(const char* fileName, uint64_t& step, std::vector<Agent>& agents, std::vector<Vector2>& path,
+    std::vector<Vector2>& obsCenters, std::vector<float>& obsRadii, SnapshotRunState& run,
+    std::vector<uint8_t>& pursuitTeam, std::vector<uint32_t>& pursuitTarget) {
+    MappedFile file;
+    if (!MapFile(fileName, file)) return false;
+    const SnapshotHeader* h = (const SnapshotHeader*)file.data;
+    bool ok = file.size >= sizeof(SnapshotHeader)
+        && memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) == 0
+        && h->version == SNAPSHOT_VERSION
+        && h->headerSize == sizeof(SnapshotHeader)
+        && h->agentStride == sizeof(Agent)
+        && h->fileSize <= file.size
+        && h->agentOffset % SNAPSHOT_ALIGN == 0 && h->pathOffset % SNAPSHOT_ALIGN == 0
+        && h->obsCenterOffset % SNAPSHOT_ALIGN == 0 && h->obsRadiusOffset % SNAPSHOT_ALIGN == 0
+        && h->runStateOffset % SNAPSHOT_ALIGN == 0 && h->pursuitTeamOffset % SNAPSHOT_ALIGN == 0
+        && h->pursuitTargetOffset % SNAPSHOT_ALIGN == 0
+        && h->agentCount <= h->fileSize / sizeof(Agent)
+        && h->pathCount <= h->fileSize / sizeof(Vector2)
+        && h->obsCount <= h->fileSize / sizeof(Vector2)
+        && h->pursuitCount <= h->fileSize / sizeof(uint32_t)
+        && h->agentOffset + h->agentCount * sizeof(Agent) <= h->fileSize
+        && h->pathOffset + h->pathCount * sizeof(Vector2) <= h->fileSize
+        && h->obsCenterOffset + h->obsCount * sizeof(Vector2) <= h->fileSize
+        && h->obsRadiusOffset + h->obsCount * sizeof(float) <= h->fileSize
+        && h->runStateOffset <= h->fileSize && sizeof(SnapshotRunState) <= h->fileSize - h->runStateOffset
+        && h->pursuitTeamOffset + h->pursuitCount * sizeof(uint8_t) <= h->fileSize
+        && h->pursuitTargetOffset + h->pursuitCount * sizeof(uint32_t) <= h->fileSize;
+    if (ok) {
+        const char* base = (const char*)file.data;
+        step = h->step;
+        const Agent* a = (const Agent*)(base + h->agentOffset);
+        agents.assign(a, a + h->agentCount);
+        const Vector2* p = (const Vector2*)(base + h->pathOffset);
+        path.assign(p, p + h->pathCount);
+        const Vector2* oc = (const Vector2*)(base + h->obsCenterOffset);
+        obsCenters.assign(oc, oc + h->obsCount);
+        const float* orad = (const float*)(base + h->obsRadiusOffset);
+        obsRadii.assign(orad, orad + h->obsCount);
+        memcpy(&run, base + h->runStateOffset, sizeof(run));
+        const uint8_t* team = (const uint8_t*)(base + h->pursuitTeamOffset);
+        pursuitTeam.assign(team, team + h->pursuitCount);
+        const uint32_t* target = (const uint32_t*)(base + h->pursuitTargetOffset);
+        pursuitTarget.assign(target, target + h->pursuitCount);
+    }
+    UnmapFile(file);
+    return ok;
+}
 
-    std::vector<Agent> agents;
-    const int AGENT_COUNT = 12;
-    for (int i = 0; i < AGENT_COUNT; ++i) {
-        Agent a;
-        a.pos = { (float)GetRandomValue(80, screenW - 80), (float)GetRandomValue(80, screenH - 80) };
-        a.vel = { (float)GetRandomValue(-50,50) / 10.0f, (float)GetRandomValue(-50,50) / 10.0f };
-        a.acc = { 0,0 };
-        a.maxSpeed = 2.4f + (GetRandomValue(0, 30) / 100.0f);
-        a.maxForce = 0.14f;
-        a.pathIndex = GetRandomValue(0, (int)path.size() - 1);
-        a.color = (i % 2 == 0) ? SKYBLUE : MAROON;
-        agents.push_back(a);
+// ---------- Replay recording ----------
+// A replay is a stream of frames: a keyframe with absolute quantized pos/vel every keyframeInterval steps and,
+// in between, per-step deltas against the previous step, Rice coded. The sim thread only copies agent state;
+// quantizing, coding and disk IO happen on the recorder thread. A keyframe index + footer close the file.
+static const char REPLAY_MAGIC[8] = { 'S','T','E','E','R','R','P','L' };
+static const uint32_t REPLAY_VERSION = 1;
+static const float REPLAY_POS_SCALE = 64.0f;    // positions kept to 1/64 px
+static const float REPLAY_VEL_SCALE = 1024.0f;  // velocities kept to 1/1024 px/step
+static const int REPLAY_CHANNELS = 4;           // pos.x pos.y vel.x vel.y
+static const size_t REPLAY_MAX_PENDING = 32;    // frames queued before the sim starts dropping instead of waiting
+enum ReplayFrameType : uint8_t { REPLAY_KEYFRAME = 1, REPLAY_DELTA = 2 };
+
+struct ReplayFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t keyframeInterval;
+    float posScale;
+    float velScale;
+};
+struct ReplayFrameHeader {
+    uint64_t step;
+    uint32_t agentCount;
+    uint32_t payloadBytes;
+    uint8_t type;
+    uint8_t riceK[REPLAY_CHANNELS]; // delta frames only
+    uint8_t pad[3];
+};
+struct ReplayIndexEntry {
+    uint64_t step;
+    uint64_t offset;
+};
+struct ReplayFooter {
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    char magic[8];
+};
+
+static int FileSeek64(FILE* f, uint64_t offset) {
+#if defined(_WIN32)
+    return _fseeki64(f, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static uint32_t ZigZag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static int32_t UnZigZag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+struct BitWriter {
+    std::vector<uint8_t> bytes;
+    uint64_t acc = 0;
+    int bits = 0;
+    void Put(uint32_t value, int count) { // count <= 32
+        acc |= (uint64_t)value << bits;
+        bits += count;
+        while (bits >= 8) { bytes.push_back((uint8_t)acc); acc >>= 8; bits -= 8; }
+    }
+    void Flush() { if (bits > 0) bytes.push_back((uint8_t)acc); acc = 0; bits = 0; }
+};
+struct BitReader {
+    const uint8_t* data;
+    size_t size, pos = 0;
+    uint64_t acc = 0;
+    int bits = 0;
+    BitReader(const uint8_t* d, size_t n) : data(d), size(n) {}
+    uint32_t Get(int count) {
+        while (bits < count) { acc |= (uint64_t)(pos < size ? data[pos] : 0) << bits; pos++; bits += 8; }
+        uint32_t v = (uint32_t)(acc & ((count == 32) ? 0xFFFFFFFFull : ((1ull << count) - 1)));
+        acc >>= count;
+        bits -= count;
+        return v;
     }
+};
 
-    // Toggles & weights
-    bool singleAgentMode = true; // if true show Task1 single-agent, else multi-agent Task2
-    bool enablePathFollowing = true;
-    bool enableSeparation = true;
-    bool enablePredictiveAvoid = true;
-    bool enableObstacleAvoid = true;
-    bool enableWallAvoid = true;
-    bool drawDebug = true;
-    bool usePriority = true; // Task3: use priority blending vs weighted blending
+// Rice code: unary quotient then k raw bits; quotients >= 32 escape to a raw 32 bit value
+static const uint32_t RICE_ESCAPE = 32;
+static void RicePut(BitWriter& w, uint32_t v, int k) {
+    uint32_t q = v >> k;
+    if (q >= RICE_ESCAPE) {
+        w.Put(0xFFFFFFFFu, 32);
+        w.Put(v, 32);
+        return;
+    }
+    if (q > 0) w.Put((1u << q) - 1, (int)q);
+    w.Put(0, 1);
+    if (k > 0) w.Put(v & ((1u << k) - 1), k);
+}
+static uint32_t RiceGet(BitReader& r, int k) {
+    uint32_t q = 0;
+    while (q < RICE_ESCAPE && r.Get(1)) q++;
+    if (q == RICE_ESCAPE) return r.Get(32);
+    return (q << k) | (k > 0 ? r.Get(k) : 0);
+}
+// Best k for a geometric-ish distribution is about log2(mean)
+static int RiceParameter(const uint32_t* v, size_t n) {
+    if (n == 0) return 0;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += v[i];
+    uint64_t mean = sum / n;
+    int k = 0;
+    while (k < 24 && (1ull << (k + 1)) <= mean) k++;
+    return k;
+}
 
-    // --- NEW: single-agent combining toggle (Task3 demonstration) ---
-    bool singleCombine = false; // press 'B' to toggle combining for single agent
+struct ReplayRecorder {
+    struct Frame {
+        uint64_t step = 0;
+        bool forceKeyframe = false;
+        std::vector<float> state; // REPLAY_CHANNELS floats per agent
+    };
 
-    float separationRadius = 48.0f;
-    float separationStrength = 0.9f;
-    float predictiveLookAhead = 0.9f;
-    float predictiveStrength = 0.9f;
-    float obstacleLookAhead = 70.0f;
-    float obstacleStrength = 1.2f;
-    float wallMargin = 40.0f;
-    float wallStrength = 1.6f;
-    float pathWaypointRadius = 22.0f;
+    FILE* file = nullptr;
+    uint32_t keyframeInterval = 120;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Frame> pending;
+    std::vector<Frame> freeFrames;
+    bool stopping = false;
+    bool dropped = false;
 
-    // main loop
-    while (!WindowShouldClose()) {
-        float dt = GetFrameTime();
+    // recorder-thread state
+    bool writeFailed = false; // a write came up short (disk full...); later frames are not written
+    uint64_t lastWrittenStep = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t lastKeyStep = 0;
+    bool haveKey = false;
+    std::vector<int32_t> prevQ;
+    std::vector<int32_t> q;
+    std::vector<uint32_t> channel;
+    std::vector<ReplayIndexEntry> index;
+};
 
-        // Input toggles
-        if (IsKeyPressed(KEY_TAB)) singleAgentMode = !singleAgentMode;
-        if (IsKeyPressed(KEY_ONE)) {
-            if (singleAgentMode) singleMode = 1; else enablePathFollowing = !enablePathFollowing;
-        }
-        if (IsKeyPressed(KEY_TWO)) {
-            if (singleAgentMode) singleMode = 2; else enableSeparation = !enableSeparation;
-        }
-        if (IsKeyPressed(KEY_THREE)) {
-            if (singleAgentMode) singleMode = 3; else enablePredictiveAvoid = !enablePredictiveAvoid;
-        }
-        if (IsKeyPressed(KEY_FOUR)) {
-            if (singleAgentMode) singleMode = 4; else enableObstacleAvoid = !enableObstacleAvoid;
-        }
-        if (IsKeyPressed(KEY_FIVE)) {
-            if (singleAgentMode) singleMode = 5; else enableWallAvoid = !enableWallAvoid;
+static void QuantizeReplayState(const std::vector<float>& state, std::vector<int32_t>& q) {
+    q.resize(state.size());
+    for (size_t i = 0; i < state.size(); ++i) {
+        float scale = (i % REPLAY_CHANNELS) < 2 ? REPLAY_POS_SCALE : REPLAY_VEL_SCALE;
+        q[i] = (int32_t)lrintf(state[i] * scale);
+    }
+}
+
+static void WriteReplayFrame(ReplayRecorder& rec, ReplayRecorder::Frame& frame) {
+    std::vector<int32_t>& q = rec.q;
+    std::vector<uint32_t>& channel = rec.channel;
+    QuantizeReplayState(frame.state, q);
+    uint32_t agentCount = (uint32_t)(q.size() / REPLAY_CHANNELS);
+
+    ReplayFrameHeader fh;
+    memset(&fh, 0, sizeof(fh));
+    fh.step = frame.step;
+    fh.agentCount = agentCount;
+
+    bool key = frame.forceKeyframe || !rec.haveKey || rec.prevQ.size() != q.size()
+        || frame.step - rec.lastKeyStep >= rec.keyframeInterval;
+    BitWriter w;
+    if (key) {
+        fh.type = REPLAY_KEYFRAME;
+        w.bytes.resize(q.size() * sizeof(int32_t));
+        if (!q.empty()) memcpy(w.bytes.data(), q.data(), w.bytes.size());
+        rec.index.push_back({ frame.step, rec.bytesWritten });
+        rec.lastKeyStep = frame.step;
+        rec.haveKey = true;
+    }
+    else {
+        fh.type = REPLAY_DELTA;
+        channel.resize(agentCount);
+        // channel-major so each coded run shares one k and similar magnitudes
+        for (int c = 0; c < REPLAY_CHANNELS; ++c) {
+            for (uint32_t i = 0; i < agentCount; ++i) {
+                size_t idx = (size_t)i * REPLAY_CHANNELS + c;
+                channel[i] = ZigZag(q[idx] - rec.prevQ[idx]);
+            }
+            int k = RiceParameter(channel.data(), agentCount);
+            fh.riceK[c] = (uint8_t)k;
+            for (uint32_t i = 0; i < agentCount; ++i) RicePut(w, channel[i], k);
         }
-        if (IsKeyPressed(KEY_SIX)) {
-            if (singleAgentMode) singleMode = 6;
+        w.Flush();
+    }
+    rec.prevQ.swap(q);
+    fh.payloadBytes = (uint32_t)w.bytes.size();
+    bool ok = fwrite(&fh, sizeof(fh), 1, rec.file) == 1
+        && (w.bytes.empty() || fwrite(w.bytes.data(), 1, w.bytes.size(), rec.file) == w.bytes.size());
+    if (!ok) { rec.writeFailed = true; return; }
+    rec.bytesWritten += sizeof(fh) + w.bytes.size();
+    rec.lastWrittenStep = frame.step;
+}
+
+static void ReplayWorker(ReplayRecorder* rec) {
+    for (;;) {
+        ReplayRecorder::Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(rec->mutex);
+            rec->wake.wait(lock, [&] { return rec->stopping || !rec->pending.empty(); });
+            if (rec->pending.empty()) return; // stopping and drained
+            frame = std::move(rec->pending.front());
+            rec->pending.pop_front();
         }
-        if (IsKeyPressed(KEY_D)) drawDebug = !drawDebug;
-        if (IsKeyPressed(KEY_P)) usePriority = !usePriority; // switch combining approach
-        if (IsKeyPressed(KEY_B)) singleCombine = !singleCombine; // NEW: toggle single-agent combining demo
+        if (!rec->writeFailed) WriteReplayFrame(*rec, frame);
+        std::lock_guard<std::mutex> lock(rec->mutex);
+        rec->freeFrames.push_back(std::move(frame));
+    }
+}
 
-        // Mouse target & mouse velocity estimation for pursue/evade
-        target = GetMousePosition();
-        Vector2 mNow = target;
-        mouseVel = Sub(mNow, mousePrev);
-        mousePrev = mNow;
+bool StartReplayRecording(ReplayRecorder& rec, const char* fileName, uint32_t keyframeInterval = 120) {
+    if (rec.file) return false;
+    rec.file = fopen(fileName, "wb");
+    if (!rec.file) return false;
+    ReplayFileHeader h;
+    memcpy(h.magic, REPLAY_MAGIC, sizeof(h.magic));
+    h.version = REPLAY_VERSION;
+    h.keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+    h.posScale = REPLAY_POS_SCALE;
+    h.velScale = REPLAY_VEL_SCALE;
+    if (fwrite(&h, sizeof(h), 1, rec.file) != 1) {
+        fclose(rec.file);
+        rec.file = nullptr;
+        return false;
+    }
+    rec.keyframeInterval = h.keyframeInterval;
+    rec.bytesWritten = sizeof(h);
+    rec.haveKey = false;
+    rec.writeFailed = false;
+    rec.stopping = false;
+    rec.dropped = false;
+    rec.prevQ.clear();
+    rec.index.clear();
+    rec.worker = std::thread(ReplayWorker, &rec);
+    return true;
+}
 
-        // ---------- Single-agent behavior (Task1) ----------
-        if (singleAgentMode) {
-            Vector2 steering = { 0,0 };
+// Called from the sim loop: copies pos/vel into a recycled buffer and hands it to the recorder thread
+void RecordReplayFrame(ReplayRecorder& rec, uint64_t step, const std::vector<Agent>& agents) {
+    if (!rec.file) return;
+    ReplayRecorder::Frame frame;
+    {
+        std::lock_guard<std::mutex> lock(rec.mutex);
+        if (rec.pending.size() >= REPLAY_MAX_PENDING) { rec.dropped = true; return; }
+        if (!rec.freeFrames.empty()) { frame = std::move(rec.freeFrames.back()); rec.freeFrames.pop_back(); }
+    }
+    frame.step = step;
+    frame.state.resize(agents.size() * REPLAY_CHANNELS);
+    float* s = frame.state.data();
+    for (const Agent& a : agents) {
+        *s++ = a.pos.x; *s++ = a.pos.y; *s++ = a.vel.x; *s++ = a.vel.y;
+    }
+    {
+        std::lock_guard<std::mutex> lock(rec.mutex);
+        // after a dropped frame the next delta would be against the wrong base, so restart with a keyframe
+        frame.forceKeyframe = rec.dropped;
+        rec.dropped = false;
+        rec.pending.push_back(std::move(frame));
+    }
+    rec.wake.notify_one();
+}
 
-            // Optionally demonstrate combining (Task3) for single agent:
-            if (singleCombine) {
-                // Weighted blend of Wander (exploration) + Seek (goal-directed)
-                Vector2 wanderF = Wander(player.pos, player.vel, player.maxSpeed, wanderAngle);
-                Vector2 seekF = Seek(player.pos, target, player.maxSpeed);
-                std::vector<std::pair<Vector2, float>> wforces;
-                wforces.push_back({ wanderF, 0.6f }); // wander 60%
-                wforces.push_back({ seekF,   1.0f }); // seek stronger
-                steering = WeightedBlend(wforces, player.maxForce * 2.0f); // produce desired velocity-ish
-            }
-            else {
-                switch (singleMode) {
-                case 1: steering = Seek(player.pos, target, player.maxSpeed); break;
-                case 2: steering = Flee(player.pos, target, player.maxSpeed); break;
-                case 3: steering = Pursue(player.pos, target, mouseVel, player.maxSpeed, 0.8f); break;
-                case 4: steering = Evade(player.pos, target, mouseVel, player.maxSpeed, 0.8f); break;
-                case 5: steering = Arrive(player.pos, target, player.maxSpeed, 140.0f); break;
-                case 6: steering = Wander(player.pos, player.vel, player.maxSpeed, wanderAngle); break;
-                }
-            }
+// Flushes the queue and writes the index and footer; false if any write failed and the file is incomplete
+bool StopReplayRecording(ReplayRecorder& rec) {
+    if (!rec.file) return true;
+    {
+        std::lock_guard<std::mutex> lock(rec.mutex);
+        rec.stopping = true;
+    }
+    rec.wake.notify_one();
+    rec.worker.join();
+    ReplayFooter footer;
+    footer.indexOffset = rec.bytesWritten;
+    footer.indexCount = rec.index.size();
+    memcpy(footer.magic, REPLAY_MAGIC, sizeof(footer.magic));
+    bool ok = !rec.writeFailed
+        && (rec.index.empty() || fwrite(rec.index.data(), sizeof(ReplayIndexEntry), rec.index.size(), rec.file) == rec.index.size())
+        && fwrite(&footer, sizeof(footer), 1, rec.file) == 1;
+    ok = (fclose(rec.file) == 0) && ok;
+    rec.file = nullptr;
+    rec.pending.clear();
+    rec.freeFrames.clear();
+    return ok;
+}
 
-            // steering returned is desired velocity (for Seek/Flee/Arrive/Wander). Convert to steering = desired - vel
-            Vector2 steerVec = Sub(steering, player.vel);
-            steerVec = Limit(steerVec, player.maxForce);
+// ---------- Replay reading ----------
+struct ReplayReader {
+    FILE* file = nullptr;
+    ReplayFileHeader header;
+    std::vector<ReplayIndexEntry> index;
+    uint64_t framesEnd = 0; // offset of the keyframe index, i.e. end of frame data
+};
 
-            // integrate (no explicit dt scaling here  frame-rate stable enough for demo)
-            player.vel = Add(player.vel, steerVec);
-            player.vel = Limit(player.vel, player.maxSpeed);
-            player.pos = Add(player.pos, player.vel);
+bool OpenReplay(ReplayReader& r, const char* fileName) {
+    r = ReplayReader();
+    r.file = fopen(fileName, "rb");
+    if (!r.file) return false;
+    ReplayFooter footer;
+    bool ok = fread(&r.header, sizeof(r.header), 1, r.file) == 1
+        && memcmp(r.header.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) == 0
+        && r.header.version == REPLAY_VERSION
+        && fseek(r.file, -(long)sizeof(footer), SEEK_END) == 0
+        && fread(&footer, sizeof(footer), 1, r.file) == 1
+        && memcmp(footer.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) == 0
+        && footer.indexCount < (1ull << 32);
+    if (ok) {
+        r.index.resize((size_t)footer.indexCount);
+        r.framesEnd = footer.indexOffset;
+        ok = FileSeek64(r.file, footer.indexOffset) == 0
+            && (r.index.empty() || fread(r.index.data(), sizeof(ReplayIndexEntry), r.index.size(), r.file) == r.index.size());
+    }
+    if (!ok) { fclose(r.file); r = ReplayReader(); }
+    return ok;
+}
 
-            // keep inside screen
-            if (player.pos.x < 0) player.pos.x = 0;
-            if (player.pos.y < 0) player.pos.y = 0;
-            if (player.pos.x > screenW) player.pos.x = screenW;
-            if (player.pos.y > screenH) player.pos.y = screenH;
+void CloseReplay(ReplayReader& r) {
+    if (r.file) fclose(r.file);
+    r = ReplayReader();
+}
+
+// Reconstructs the recorded state at `step` (or the closest earlier recorded step): jumps to the nearest
+// keyframe through the index, then applies at most keyframeInterval deltas. Returns the step actually decoded.
+bool SeekReplay(ReplayReader& r, uint64_t step, std::vector<Vector2>& pos, std::vector<Vector2>& vel, uint64_t* decodedStep = nullptr) {
+    if (!r.file || r.index.empty() || step < r.index.front().step) return false;
+    size_t lo = 0, hi = r.index.size();
+    while (hi - lo > 1) { // last keyframe with step <= target
+        size_t mid = (lo + hi) / 2;
+        if (r.index[mid].step <= step) lo = mid; else hi = mid;
+    }
+    if (FileSeek64(r.file, r.index[lo].offset) != 0) return false;
+
+    std::vector<int32_t> q;
+    std::vector<uint8_t> payload;
+    uint64_t offset = r.index[lo].offset;
+    uint64_t current = 0;
+    bool haveKey = false;
+    while (offset < r.framesEnd) {
+        ReplayFrameHeader fh;
+        if (fread(&fh, sizeof(fh), 1, r.file) != 1) return false;
+        if (haveKey && (fh.step > step || fh.type == REPLAY_KEYFRAME)) break;
+        payload.resize(fh.payloadBytes);
+        if (fh.payloadBytes && fread(payload.data(), 1, fh.payloadBytes, r.file) != fh.payloadBytes) return false;
+        offset += sizeof(fh) + fh.payloadBytes;
+        size_t n = (size_t)fh.agentCount * REPLAY_CHANNELS;
+        if (fh.type == REPLAY_KEYFRAME) {
+            if (payload.size() != n * sizeof(int32_t)) return false;
+            q.resize(n);
+            if (n) memcpy(q.data(), payload.data(), payload.size());
+            haveKey = true;
         }
-        // ---------- Multi-agent behaviors (Task2) ----------
         else {
-            for (size_t i = 0; i < agents.size(); ++i) {
-                Agent& a = agents[i];
-                a.acc = { 0,0 };
-
-                // compute component behaviors
-                Vector2 steerPath = { 0,0 };
-                if (enablePathFollowing) {
-                    Vector2 desired = PathFollowing(a, path, a.pathIndex, pathWaypointRadius);
-                    steerPath = Sub(desired, a.vel);
-                }
+            if (!haveKey || q.size() != n) return false;
+            BitReader br(payload.data(), payload.size());
+            for (int c = 0; c < REPLAY_CHANNELS; ++c)
+                for (uint32_t i = 0; i < fh.agentCount; ++i)
+                    q[(size_t)i * REPLAY_CHANNELS + c] += UnZigZag(RiceGet(br, fh.riceK[c]));
+        }
+        current = fh.step;
+    }
+    size_t count = q.size() / REPLAY_CHANNELS;
+    pos.resize(count);
+    vel.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const int32_t* s = &q[i * REPLAY_CHANNELS];
+        pos[i] = { s[0] / r.header.posScale, s[1] / r.header.posScale };
+        vel[i] = { s[2] / r.header.velScale, s[3] / r.header.velScale };
+    }
+    if (decodedStep) *decodedStep = current;
+    return true;
+}
 
-                Vector2 steerSep = { 0,0 };
-                if (enableSeparation) {
-                    steerSep = Separation(a, agents, separationRadius, separationStrength);
-                }
+// Round trip check for a stopped recording: seeks the file to the last written step and compares the decoded
+// state with what the recorder quantized, bit for bit
+bool VerifyReplay(const ReplayRecorder& rec, const char* fileName) {
+    if (rec.index.empty()) return true; // nothing was recorded
+    ReplayReader r;
+    if (!OpenReplay(r, fileName)) return false;
+    std::vector<Vector2> pos, vel;
+    uint64_t decoded = 0;
+    bool ok = SeekReplay(r, rec.lastWrittenStep, pos, vel, &decoded) && decoded == rec.lastWrittenStep
+        && pos.size() * REPLAY_CHANNELS == rec.prevQ.size();
+    for (size_t i = 0; ok && i < pos.size(); ++i) {
+        const int32_t* q = &rec.prevQ[i * REPLAY_CHANNELS];
+        ok = lrintf(pos[i].x * r.header.posScale) == q[0] && lrintf(pos[i].y * r.header.posScale) == q[1]
+            && lrintf(vel[i].x * r.header.velScale) == q[2] && lrintf(vel[i].y * r.header.velScale) == q[3];
+    }
+    CloseReplay(r);
+    return ok;
+}
 
-                Vector2 steerPredict = { 0,0 };
-                if (enablePredictiveAvoid) {
-                    for (size_t j = 0; j < agents.size(); ++j) {
-                        if (i == j) continue;
-                        Vector2 s = PredictiveAvoidance(a, agents[j], predictiveLookAhead, predictiveStrength);
-                        steerPredict = Add(steerPredict, s);
-                    }
-                }
+// ---------- Columnar trajectory export ----------
+// One row per agent per step. Rows are buffered column-wise into fixed size chunks; when a chunk fills it is
+// swapped with its twin and handed to the writer thread, which appends each column's slice contiguously.
+// On close a footer with the column schema and a per-chunk offset index is written, so readers can pull
+// single columns (or skip chunks by step range) without scanning the file.
+enum TrajectoryColumn {
+    TRAJ_STEP, TRAJ_AGENT, TRAJ_ACTIVE,
+    TRAJ_POS_X, TRAJ_POS_Y, TRAJ_VEL_X, TRAJ_VEL_Y,
+    TRAJ_PATH_X, TRAJ_PATH_Y, TRAJ_SEP_X, TRAJ_SEP_Y, TRAJ_PREDICT_X, TRAJ_PREDICT_Y,
+    TRAJ_OBS_X, TRAJ_OBS_Y, TRAJ_WALL_X, TRAJ_WALL_Y,
+    TRAJ_COLUMN_COUNT
+};
+enum TrajectoryColumnType : uint32_t { TRAJ_U32 = 1, TRAJ_F32 = 2 };
+struct TrajectoryColumnDesc {
+    char name[16];
+    uint32_t type;
+};
+static const TrajectoryColumnDesc TRAJ_COLUMNS[TRAJ_COLUMN_COUNT] = {
+    { "step", TRAJ_U32 }, { "agent", TRAJ_U32 }, { "active", TRAJ_U32 },
+    { "pos_x", TRAJ_F32 }, { "pos_y", TRAJ_F32 }, { "vel_x", TRAJ_F32 }, { "vel_y", TRAJ_F32 },
+    { "path_x", TRAJ_F32 }, { "path_y", TRAJ_F32 }, { "sep_x", TRAJ_F32 }, { "sep_y", TRAJ_F32 },
+    { "predict_x", TRAJ_F32 }, { "predict_y", TRAJ_F32 }, { "obs_x", TRAJ_F32 }, { "obs_y", TRAJ_F32 },
+    { "wall_x", TRAJ_F32 }, { "wall_y", TRAJ_F32 },
+};
+// bits of the "active" column
+static const uint32_t TRAJ_ACTIVE_PATH = 1, TRAJ_ACTIVE_SEP = 2, TRAJ_ACTIVE_PREDICT = 4, TRAJ_ACTIVE_OBS = 8,
+    TRAJ_ACTIVE_WALL = 16, TRAJ_ACTIVE_PRIORITY = 32, TRAJ_ACTIVE_CONTINUUM = 64;
+static const char TRAJ_MAGIC[8] = { 'S','T','E','E','R','C','O','L' };
+static const uint32_t TRAJ_VERSION = 1;
 
-                Vector2 steerObs = { 0,0 };
-                if (enableObstacleAvoid) steerObs = ObstacleAvoidance(a, obsCenters, obsRadii, obstacleLookAhead, obstacleStrength);
-
-                Vector2 steerWall = { 0,0 };
-                if (enableWallAvoid) steerWall = WallAvoidance(a, screenW, screenH, wallMargin, wallStrength);
-
-                // Combine - either priority or weighted blend (Task3)
-                Vector2 finalSteer = { 0,0 };
-                if (usePriority) {
-                    // priority order (highest -> lowest)
-                    std::vector<Vector2> priorityForces;
-                    priorityForces.push_back(Limit(Add(Scale(steerObs, 2.0f), Scale(steerWall, 1.8f)), a.maxForce)); // immediate danger
-                    priorityForces.push_back(Limit(Add(Scale(steerPredict, 1.4f), Scale(steerSep, 1.2f)), a.maxForce)); // safety
-                    priorityForces.push_back(Limit(Scale(steerPath, 0.9f), a.maxForce)); // navigation
-                    finalSteer = PrioritySteering(priorityForces);
-                }
-                else {
-                    // weighted blending
-                    std::vector<std::pair<Vector2, float>> wforces;
-                    wforces.push_back({ steerObs, 1.8f });
-                    wforces.push_back({ steerWall, 1.4f });
-                    wforces.push_back({ steerPredict, 1.2f });
-                    wforces.push_back({ steerSep, 1.0f });
-                    wforces.push_back({ steerPath, 0.9f });
-                    finalSteer = WeightedBlend(wforces, a.maxForce);
-                }
+struct TrajectoryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunkRows;
+};
+struct TrajectoryChunkEntry {
+    uint32_t rows;
+    uint32_t firstStep, lastStep;
+    uint32_t pad;
+    uint64_t columnOffset[TRAJ_COLUMN_COUNT];
+};
+struct TrajectoryFooter {
+    uint64_t schemaOffset;  // TrajectoryColumnDesc[columnCount]
+    uint64_t indexOffset;   // TrajectoryChunkEntry[chunkCount]
+    uint64_t droppedRows;   // rows lost because the writer was still busy with the previous chunk
+    uint32_t columnCount;
+    uint32_t chunkCount;
+    char magic[8];
+};
 
-                // Apply as acceleration-like steering
-                finalSteer = Limit(finalSteer, a.maxForce);
-                a.vel = Add(a.vel, finalSteer);
-                a.vel = Limit(a.vel, a.maxSpeed);
-                a.pos = Add(a.pos, a.vel);
+struct TrajectoryExporter {
+    struct Chunk {
+        std::vector<uint32_t> columns[TRAJ_COLUMN_COUNT];
+        uint32_t rows = 0;
+    };
 
-                // simple wrap-around prevention:
-                if (a.pos.x < -60) a.pos.x = screenW + 60;
-                if (a.pos.x > screenW + 60) a.pos.x = -60;
-                if (a.pos.y < -60) a.pos.y = screenH + 60;
-                if (a.pos.y > screenH + 60) a.pos.y = -60;
-            }
-        }
+    FILE* file = nullptr;
+    uint32_t chunkRows = 0;
+    Chunk buffers[2];
+    int active = 0;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    Chunk* submitted = nullptr;
+    bool stopping = false;
+    uint64_t droppedRows = 0;
 
-        // ---------- Drawing ----------
-        BeginDrawing();
-        ClearBackground(WHITE);
+    // writer-thread state
+    uint64_t bytesWritten = 0;
+    std::vector<TrajectoryChunkEntry> index;
+    bool writeFailed = false; // a write came up short (disk full...); nothing more is written, read under mutex
+};
 
-        // Draw path
-        for (size_t i = 0;i < path.size();++i) {
-            Vector2 a = path[i];
-            Vector2 b = path[(i + 1) % path.size()];
-            DrawLineEx(a, b, 2.0f, LIGHTGRAY);
-            DrawCircleV(a, 6, DARKGRAY);
+static void WriteTrajectoryChunk(TrajectoryExporter& ex, TrajectoryExporter::Chunk& chunk) {
+    if (chunk.rows == 0 || ex.writeFailed) { chunk.rows = 0; return; }
+    TrajectoryChunkEntry e;
+    memset(&e, 0, sizeof(e));
+    e.rows = chunk.rows;
+    e.firstStep = chunk.columns[TRAJ_STEP][0];
+    e.lastStep = chunk.columns[TRAJ_STEP][chunk.rows - 1];
+    for (int c = 0; c < TRAJ_COLUMN_COUNT; ++c) {
+        e.columnOffset[c] = ex.bytesWritten;
+        if (fwrite(chunk.columns[c].data(), sizeof(uint32_t), chunk.rows, ex.file) != chunk.rows) {
+            ex.writeFailed = true;
+            chunk.rows = 0;
+            return;
         }
+        ex.bytesWritten += (uint64_t)chunk.rows * sizeof(uint32_t);
+    }
+    ex.index.push_back(e);
+    chunk.rows = 0;
+}
 
-        // Draw obstacles
-        for (size_t i = 0;i < obsCenters.size();++i) {
-            DrawCircleV(obsCenters[i], obsRadii[i], Fade(RED, 0.22f));
-            DrawCircleLines((int)obsCenters[i].x, (int)obsCenters[i].y, obsRadii[i], RED);
-            if (drawDebug) {
-                DrawText(TextFormat("Obs %d", (int)i), (int)obsCenters[i].x - 18, (int)obsCenters[i].y - (int)obsRadii[i] - 18, 10, DARKGRAY);
-            }
-        }
+static void TrajectoryWriter(TrajectoryExporter* ex) {
+    std::unique_lock<std::mutex> lock(ex->mutex);
+    for (;;) {
+        ex->wake.wait(lock, [&] { return ex->stopping || ex->submitted != nullptr; });
+        if (!ex->submitted) return;
+        TrajectoryExporter::Chunk* chunk = ex->submitted;
+        lock.unlock();
+        WriteTrajectoryChunk(*ex, *chunk);
+        lock.lock(); // publishes writeFailed to the sim thread
+        ex->submitted = nullptr;
+        ex->idle.notify_all();
+    }
+}
 
-        // Draw either single agent (Task1) or agents (Task2)
-        if (singleAgentMode) {
-            // draw target
-            DrawCircleV(target, 7, DARKBLUE);
+bool StartTrajectoryExport(TrajectoryExporter& ex, const char* fileName, uint32_t chunkRows = 65536) {
+    if (ex.file || chunkRows == 0) return false;
+    ex.file = fopen(fileName, "wb");
+    if (!ex.file) return false;
+    TrajectoryFileHeader h;
+    memcpy(h.magic, TRAJ_MAGIC, sizeof(h.magic));
+    h.version = TRAJ_VERSION;
+    h.chunkRows = chunkRows;
+    if (fwrite(&h, sizeof(h), 1, ex.file) != 1) {
+        fclose(ex.file);
+        ex.file = nullptr;
+        return false;
+    }
+    ex.chunkRows = chunkRows;
+    ex.bytesWritten = sizeof(h);
+    ex.index.clear();
+    ex.droppedRows = 0;
+    ex.writeFailed = false;
+    ex.active = 0;
+    ex.submitted = nullptr;
+    ex.stopping = false;
+    for (TrajectoryExporter::Chunk& chunk : ex.buffers) {
+        chunk.rows = 0;
+        for (std::vector<uint32_t>& col : chunk.columns) col.resize(chunkRows);
+    }
+    ex.writer = std::thread(TrajectoryWriter, &ex);
+    return true;
+}
 
-            // draw debug circle at player pos so you can see it even if triangle color blends
-            if (drawDebug) DrawCircleLines((int)player.pos.x, (int)player.pos.y, 18, Fade(BLACK, 0.15f));
+static void PutF32(std::vector<uint32_t>& col, uint32_t row, float v) { memcpy(&col[row], &v, sizeof(v)); }
 
-            // draw player triangle
-            DrawAgentTriangle(player.pos, player.vel, ORANGE);
+// Appends one agent row from the sim loop. Never waits on the writer: if both buffers are busy the
+// full chunk is discarded and counted in droppedRows.
+void ExportTrajectoryRow(TrajectoryExporter& ex, uint32_t step, uint32_t agentIndex, uint32_t activeBits, const Agent& a,
+    Vector2 steerPath, Vector2 steerSep, Vector2 steerPredict, Vector2 steerObs, Vector2 steerWall) {
+    if (!ex.file) return;
+    TrajectoryExporter::Chunk& chunk = ex.buffers[ex.active];
+    uint32_t r = chunk.rows;
+    std::vector<uint32_t>* col = chunk.columns;
+    col[TRAJ_STEP][r] = step;
+    col[TRAJ_AGENT][r] = agentIndex;
+    col[TRAJ_ACTIVE][r] = activeBits;
+    PutF32(col[TRAJ_POS_X], r, a.pos.x); PutF32(col[TRAJ_POS_Y], r, a.pos.y);
+    PutF32(col[TRAJ_VEL_X], r, a.vel.x); PutF32(col[TRAJ_VEL_Y], r, a.vel.y);
+    PutF32(col[TRAJ_PATH_X], r, steerPath.x); PutF32(col[TRAJ_PATH_Y], r, steerPath.y);
+    PutF32(col[TRAJ_SEP_X], r, steerSep.x); PutF32(col[TRAJ_SEP_Y], r, steerSep.y);
+    PutF32(col[TRAJ_PREDICT_X], r, steerPredict.x); PutF32(col[TRAJ_PREDICT_Y], r, steerPredict.y);
+    PutF32(col[TRAJ_OBS_X], r, steerObs.x); PutF32(col[TRAJ_OBS_Y], r, steerObs.y);
+    PutF32(col[TRAJ_WALL_X], r, steerWall.x); PutF32(col[TRAJ_WALL_Y], r, steerWall.y);
+    if (++chunk.rows < ex.chunkRows) return;
 
-            if (drawDebug) {
-                DrawText(TextFormat("Single-agent mode: %s %s",
+    std::lock_guard<std::mutex> lock(ex.mutex);
+    if (ex.writeFailed) { chunk.rows = 0; return; } // the export has stopped, StopTrajectoryExport reports it
+    if (ex.submitted) {
+        ex.droppedRows += chunk.rows;
+        chunk.rows = 0;
+        return;
+    }
+    ex.submitted = &chunk;
+    ex.active ^= 1;
+    ex.wake.notify_one();
+}
+
+// Writes the partial last chunk, the schema, index and footer; false if any write failed and the file is incomplete
+bool StopTrajectoryExport(TrajectoryExporter& ex) {
+    if (!ex.file) return true;
+    {
+        std::unique_lock<std::mutex> lock(ex.mutex);
+        ex.idle.wait(lock, [&] { return ex.submitted == nullptr; });
+        ex.stopping = true;
+    }
+    ex.wake.notify_one();
+    ex.writer.join();
+    WriteTrajectoryChunk(ex, ex.buffers[ex.active]); // partial last chunk
+
+    TrajectoryFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.schemaOffset = ex.bytesWritten;
+    footer.indexOffset = footer.schemaOffset + sizeof(TRAJ_COLUMNS);
+    footer.droppedRows = ex.droppedRows;
+    footer.columnCount = TRAJ_COLUMN_COUNT;
+    footer.chunkCount = (uint32_t)ex.index.size();
+    memcpy(footer.magic, TRAJ_MAGIC, sizeof(footer.magic));
+    bool ok = !ex.writeFailed
+        && fwrite(TRAJ_COLUMNS, sizeof(TrajectoryColumnDesc), TRAJ_COLUMN_COUNT, ex.file) == TRAJ_COLUMN_COUNT
+        && (ex.index.empty() || fwrite(ex.index.data(), sizeof(TrajectoryChunkEntry), ex.index.size(), ex.file) == ex.index.size())
+        && fwrite(&footer, sizeof(footer), 1, ex.file) == 1;
+    ok = (fclose(ex.file) == 0) && ok;
+    ex.file = nullptr;
+    for (TrajectoryExporter::Chunk& chunk : ex.buffers)
+        for (std::vector<uint32_t>& col : chunk.columns) std::vector<uint32_t>().swap(col);
+    return ok;
+}
+
+// ---------- Denormals ----------
+// Arrive() and the averaging behaviors can leave velocities decaying through the denormal range, where every
+// operation takes a microcode assist. Sim threads run with flush-to-zero and denormals-are-zero instead; the
+// main thread, every pool worker and domain workers all call this, so results stay identical across threads.
+static void EnableFlushDenormals() {
+#if defined(STEER_SSE2)
+    _mm_setcsr(_mm_getcsr() | 0x8040); // FTZ (bit 15) | DAZ (bit 6)
+#endif
+}
+
+// ---------- Sampling profiler ----------
+// Opt-in (--profile <hz>) statistical profiler, for the slow parts nobody thought to time. On POSIX a
+// process-wide ITIMER_PROF timer raises SIGPROF on whichever thread is using CPU. The handler walks the frame
+// pointers of the interrupted context and pushes the addresses into a lock-free bounded queue (Vyukov style, a
+// full queue drops the sample). The walk stays inside the stack ProfilerRegisterThread recorded for the thread;
+// threads that never registered only get the leaf. Stacks past the leaf need -fno-omit-frame-pointer (without
+// it the chain is garbage, but the bounds keep the walk on the stack), and names for non-exported functions
+// need -rdynamic. Windows has no SIGPROF, so a sampler thread suspends each registered thread that
+// used CPU since its last tick and records only its instruction pointer, since x64 code keeps no frame chain to
+// walk; there only self time is meaningful. The main thread drains the queue every step, then folds and
+// symbolises (dladdr / dbghelp) the addresses into per-function counts.
+static const int PROFILE_MAX_DEPTH = 16;
+static const uint32_t PROFILE_QUEUE_SIZE = 1u << 14; // samples in flight between drains, power of two
+static const int PROFILE_TOP = 12;
+
+struct ProfileSample {
+    std::atomic<uint32_t> seq;
+    uint32_t depth;
+    uintptr_t pc[PROFILE_MAX_DEPTH]; // interrupted instruction, then return addresses outwards
+};
+
+struct ProfileFunction {
+    std::string name;
+    uint64_t self = 0;  // samples with the function at the top of the stack
+    uint64_t total = 0; // samples with the function anywhere on the stack
+};
+
+struct Profiler {
+    std::atomic<bool> running{ false };
+    int hz = 0;
+    std::unique_ptr<ProfileSample[]> queue;
+    std::atomic<uint32_t> head{ 0 };
+    uint32_t tail = 0;
+    std::atomic<uint64_t> dropped{ 0 };
+    uint64_t samples = 0;
+    std::unordered_map<uintptr_t, uintptr_t> functionOf;      // address -> function entry
+    std::unordered_map<uintptr_t, ProfileFunction> functions; // by entry
+#if defined(_WIN32)
+    std::thread sampler;
+    std::mutex threadsMutex;
+    std::vector<HANDLE> threads;
+    std::vector<uint64_t> threadCpu; // kernel + user time at the previous tick
+#endif
+};
+
+// The signal handler takes no arguments, so there is one profiler per process
+static Profiler& SamplingProfiler() {
+    static Profiler p;
+    return p;
+}
+
+#if !defined(_WIN32)
+// [lo, hi) of the calling thread's stack, set by ProfilerRegisterThread; hi = 0 until then
+static thread_local uintptr_t profileStackLo = 0, profileStackHi = 0;
+#endif
+
+// Async-signal-safe: no locks, no allocation
+static void PushProfileSample(Profiler& p, const uintptr_t* pc, uint32_t depth) {
+    uint32_t pos = p.head.load(std::memory_order_relaxed);
+    for (;;) {
+        int32_t diff = (int32_t)(p.queue[pos & (PROFILE_QUEUE_SIZE - 1)].seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (p.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {
+            p.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else pos = p.head.load(std::memory_order_relaxed);
+    }
+    ProfileSample& slot = p.queue[pos & (PROFILE_QUEUE_SIZE - 1)];
+    slot.depth = depth;
+    for (uint32_t d = 0; d < depth; ++d) slot.pc[d] = pc[d];
+    slot.seq.store(pos + 1, std::memory_order_release);
+}
+
+#if !defined(_WIN32)
+static void ProfileSignalHandler(int, siginfo_t*, void* context) {
+    int savedErrno = errno;
+    ucontext_t* uc = (ucontext_t*)context;
+    uintptr_t ip = 0, fp = 0, sp = 0;
+#if defined(__linux__) && defined(__x86_64__)
+    ip = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+    fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+    sp = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+#elif defined(__linux__) && defined(__aarch64__)
+    ip = (uintptr_t)uc->uc_mcontext.pc;
+    fp = (uintptr_t)uc->uc_mcontext.regs[29];
+    sp = (uintptr_t)uc->uc_mcontext.sp;
+#elif defined(__APPLE__) && defined(__x86_64__)
+    ip = (uintptr_t)uc->uc_mcontext->__ss.__rip;
+    fp = (uintptr_t)uc->uc_mcontext->__ss.__rbp;
+    sp = (uintptr_t)uc->uc_mcontext->__ss.__rsp;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    ip = (uintptr_t)arm_thread_state64_get_pc(uc->uc_mcontext->__ss);
+    fp = (uintptr_t)arm_thread_state64_get_fp(uc->uc_mcontext->__ss);
+    sp = (uintptr_t)arm_thread_state64_get_sp(uc->uc_mcontext->__ss);
+#else
+    (void)uc;
+#endif
+    if (ip) {
+        uintptr_t pc[PROFILE_MAX_DEPTH];
+        uint32_t depth = 0;
+        pc[depth++] = ip;
+        uintptr_t lo = std::max(sp, profileStackLo), hi = profileStackHi;
+        // a frame is {saved fp, return address}; stop at anything that doesn't look like a frame on this stack
+        while (depth < PROFILE_MAX_DEPTH && fp >= lo && hi >= 2 * sizeof(uintptr_t) && fp <= hi - 2 * sizeof(uintptr_t)
+            && (fp & (sizeof(uintptr_t) - 1)) == 0) {
+            const uintptr_t* frame = (const uintptr_t*)fp;
+            if (!frame[1]) break;
+            pc[depth++] = frame[1];
+            if (frame[0] <= fp) break;
+            fp = frame[0];
+        }
+        PushProfileSample(SamplingProfiler(), pc, depth);
+    }
+    errno = savedErrno;
+}
+#else
+static void ProfileSamplerLoop(Profiler* p) {
+    std::chrono::microseconds period(1000000 / p->hz);
+    while (p->running.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(period);
+        std::lock_guard<std::mutex> lock(p->threadsMutex);
+        for (size_t i = 0; i < p->threads.size(); ++i) {
+            // only threads that ran since the last tick, like ITIMER_PROF
+            FILETIME created, exited, kernel, user;
+            if (!GetThreadTimes(p->threads[i], &created, &exited, &kernel, &user)) continue;
+            uint64_t cpu = ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) + ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+            if (cpu == p->threadCpu[i]) continue;
+            p->threadCpu[i] = cpu;
+            if (SuspendThread(p->threads[i]) == (DWORD)-1) continue;
+            CONTEXT ctx;
+            memset(&ctx, 0, sizeof(ctx));
+            ctx.ContextFlags = CONTEXT_CONTROL;
+            if (GetThreadContext(p->threads[i], &ctx)) {
+#if defined(_M_X64)
+                uintptr_t pc = (uintptr_t)ctx.Rip;
+#elif defined(_M_ARM64)
+                uintptr_t pc = (uintptr_t)ctx.Pc;
+#else
+                uintptr_t pc = (uintptr_t)ctx.Eip;
+#endif
+                PushProfileSample(*p, &pc, 1);
+            }
+            ResumeThread(p->threads[i]);
+        }
+    }
+}
+#endif
+
+// Lets the Windows sampler see the calling thread; on POSIX records the thread's stack extent, which bounds the
+// frame-pointer walk in ProfileSignalHandler
+static void ProfilerRegisterThread() {
+#if defined(__linux__)
+    pthread_attr_t attr;
+    void* base = nullptr;
+    size_t size = 0;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) return;
+    if (pthread_attr_getstack(&attr, &base, &size) == 0) {
+        profileStackLo = (uintptr_t)base;
+        profileStackHi = (uintptr_t)base + size;
+    }
+    pthread_attr_destroy(&attr);
+#elif defined(__APPLE__)
+    uintptr_t top = (uintptr_t)pthread_get_stackaddr_np(pthread_self()); // stacks grow down from here
+    profileStackLo = top - pthread_get_stacksize_np(pthread_self());
+    profileStackHi = top;
+#elif defined(_WIN32)
+    Profiler& p = SamplingProfiler();
+    HANDLE h = nullptr;
+    if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &h,
+        THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE, 0)) return;
+    std::lock_guard<std::mutex> lock(p.threadsMutex);
+    p.threads.push_back(h);
+    p.threadCpu.push_back(0);
+#endif
+}
+
+bool StartProfiler(int hz) {
+    Profiler& p = SamplingProfiler();
+    if (p.running || hz <= 0) return false;
+    p.hz = std::min(hz, 10000);
+    p.queue.reset(new ProfileSample[PROFILE_QUEUE_SIZE]);
+    for (uint32_t i = 0; i < PROFILE_QUEUE_SIZE; ++i) p.queue[i].seq.store(i, std::memory_order_relaxed);
+    p.head.store(0, std::memory_order_relaxed);
+    p.tail = 0;
+#if defined(_WIN32)
+    SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS);
+    if (!SymInitialize(GetCurrentProcess(), nullptr, TRUE)) return false;
+    p.running = true;
+    p.sampler = std::thread(ProfileSamplerLoop, &p);
+#else
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = ProfileSignalHandler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, nullptr) != 0) return false;
+    long usec = 1000000L / p.hz;
+    itimerval timer;
+    timer.it_interval.tv_sec = usec / 1000000L;
+    timer.it_interval.tv_usec = usec % 1000000L;
+    timer.it_value = timer.it_interval;
+    p.running = true;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        p.running = false;
+        return false;
+    }
+#endif
+    return true;
+}
+
+static void ResolveProfileSymbol(uintptr_t pc, uintptr_t& entry, std::string& name) {
+    char buf[64];
+#if defined(_WIN32)
+    alignas(SYMBOL_INFO) char storage[sizeof(SYMBOL_INFO) + 256];
+    SYMBOL_INFO* sym = (SYMBOL_INFO*)storage;
+    memset(sym, 0, sizeof(SYMBOL_INFO));
+    sym->SizeOfStruct = sizeof(SYMBOL_INFO);
+    sym->MaxNameLen = 255;
+    DWORD64 displacement = 0;
+    if (SymFromAddr(GetCurrentProcess(), (DWORD64)pc, &displacement, sym)) {
+        entry = (uintptr_t)sym->Address;
+        name = sym->Name;
+        return;
+    }
+#else
+    Dl_info info;
+    if (dladdr((void*)pc, &info) && info.dli_sname) {
+        entry = (uintptr_t)info.dli_saddr;
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        name = status == 0 && demangled ? demangled : info.dli_sname;
+        free(demangled);
+        return;
+    }
+#endif
+    snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)pc);
+    entry = pc;
+    name = buf;
+}
+
+static ProfileFunction& ProfileFunctionAt(Profiler& p, uintptr_t pc) {
+    auto it = p.functionOf.find(pc);
+    if (it != p.functionOf.end()) return p.functions[it->second];
+    uintptr_t entry = pc;
+    std::string name;
+    ResolveProfileSymbol(pc, entry, name);
+    p.functionOf[pc] = entry;
+    ProfileFunction& f = p.functions[entry];
+    if (f.name.empty()) f.name = name;
+    return f;
+}
+
+// Folds the queued samples into p.functions; main thread only
+void DrainProfiler() {
+    Profiler& p = SamplingProfiler();
+    if (!p.queue) return;
+    for (;;) {
+        ProfileSample& slot = p.queue[p.tail & (PROFILE_QUEUE_SIZE - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != p.tail + 1) break;
+        const ProfileFunction* seen[PROFILE_MAX_DEPTH];
+        uint32_t unique = 0;
+        for (uint32_t d = 0; d < slot.depth; ++d) {
+            // a return address points past its call, which may already be the next function
+            ProfileFunction& f = ProfileFunctionAt(p, d == 0 ? slot.pc[d] : slot.pc[d] - 1);
+            if (d == 0) f.self++;
+            if (std::find(seen, seen + unique, &f) != seen + unique) continue; // recursion counts once
+            seen[unique++] = &f;
+            f.total++;
+        }
+        p.samples++;
+        slot.seq.store(p.tail + PROFILE_QUEUE_SIZE, std::memory_order_release);
+        p.tail++;
+    }
+}
+
+void StopProfiler() {
+    Profiler& p = SamplingProfiler();
+    if (!p.running) return;
+#if defined(_WIN32)
+    p.running = false;
+    p.sampler.join();
+#else
+    itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, nullptr);
+    signal(SIGPROF, SIG_IGN); // a tick still in flight must not take the default action (exit)
+    p.running = false;
+#endif
+    DrainProfiler();
+}
+
+// The n functions with the most self samples
+std::vector<const ProfileFunction*> TopProfileFunctions(int n) {
+    const Profiler& p = SamplingProfiler();
+    std::vector<const ProfileFunction*> top;
+    for (const auto& f : p.functions) top.push_back(&f.second);
+    std::sort(top.begin(), top.end(), [](const ProfileFunction* a, const ProfileFunction* b) {
+        return a->self != b->self ? a->self > b->self : a->total > b->total;
+    });
+    if ((int)top.size() > n) top.resize(n);
+    return top;
+}
+
+void LogProfile() {
+    const Profiler& p = SamplingProfiler();
+    if (p.samples == 0) return;
+    TraceLog(LOG_INFO, "Profile: %llu samples at %d Hz, %llu dropped", (unsigned long long)p.samples, p.hz,
+        (unsigned long long)p.dropped.load());
+    for (const ProfileFunction* f : TopProfileFunctions(PROFILE_TOP))
+        TraceLog(LOG_INFO, "  %5.1f%% self %5.1f%% total  %s", 100.0 * f->self / p.samples, 100.0 * f->total / p.samples, f->name.c_str());
+}
+
+// ---------- Worker threads ----------
+// Small persistent pool behind ParallelFor. The calling thread works as worker 0.
+// ParallelFor must not be called from inside a ParallelFor job.
+struct WorkerPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex, dispatch;
+    std::condition_variable wake, finished;
+    const std::function<void(unsigned)>* job = nullptr;
+    uint64_t generation = 0;
+    unsigned pending = 0;
+    bool quit = false;
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : threads) t.join();
+    }
+};
+
+static void PoolWorker(WorkerPool* pool, unsigned index) {
+    EnableFlushDenormals();
+    ProfilerRegisterThread();
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    for (;;) {
+        pool->wake.wait(lock, [&] { return pool->quit || pool->generation != seen; });
+        if (pool->quit) return;
+        seen = pool->generation;
+        const std::function<void(unsigned)>* job = pool->job;
+        lock.unlock();
+        (*job)(index);
+        lock.lock();
+        if (--pool->pending == 0) pool->finished.notify_one();
+    }
+}
+
+static WorkerPool& Workers() {
+    static WorkerPool pool;
+    static std::once_flag started;
+    std::call_once(started, [] {
+        unsigned n = std::thread::hardware_concurrency();
+        for (unsigned i = 1; i < (n ? n : 4); ++i) pool.threads.emplace_back(PoolWorker, &pool, i);
+    });
+    return pool;
+}
+
+static unsigned WorkerCount() { return (unsigned)Workers().threads.size() + 1; }
+
+// Splits [0, count) into contiguous ranges and runs fn(begin, end, worker) for each range in parallel
+template <typename Fn>
+void ParallelFor(size_t count, const Fn& fn, size_t minPerWorker = 1024) {
+    if (count == 0) return;
+    WorkerPool& pool = Workers();
+    size_t workers = std::min<size_t>(WorkerCount(), (count + minPerWorker - 1) / minPerWorker);
+    if (workers <= 1) { fn((size_t)0, count, 0u); return; }
+    std::function<void(unsigned)> job = [&](unsigned w) {
+        if (w >= workers) return;
+        fn(count * w / workers, count * (w + 1) / workers, w);
+    };
+    std::lock_guard<std::mutex> serial(pool.dispatch);
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.job = &job;
+        pool.pending = (unsigned)pool.threads.size();
+        pool.generation++;
+    }
+    pool.wake.notify_all();
+    job(0);
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.finished.wait(lock, [&] { return pool.pending == 0; });
+}
+
+// ---------- Scenario files ----------
+// Plain text, one directive per line, '#' starts a comment:
+//   waypoint <x> <y>                                       appended to the path in file order
+//   obstacle <x> <y> <radius>
+//   agent <x> <y> <vx> <vy> <maxSpeed> [pathIndex]         explicit agent
+//   spawn <count> <x0> <y0> <x1> <y1> [minSpeed maxSpeed]  random agents inside a rectangle, then optionally
+//         vel <vx0> <vy0> <vx1> <vy1>                      velocity components drawn from [vx0, vx1) x [vy0, vy1)
+//         path random|sequential|nearest|fixed <index>     first waypoint of each agent (default random)
+//         clear <distance>                                 redraw positions closer than this to an obstacle
+//                                                          (default: LoadScenario's spawnClearance)
+//   seed <n>                                               seeds the spawn directives
+// Large files are mapped and split into line-aligned ranges that are tokenized in parallel straight out of
+// the mapping; spawned agents are then generated in parallel from the counter-based RNG, so the result does not
+// depend on the thread count.
+struct ScenarioToken {
+    const char* p;
+    size_t n;
+    bool Is(const char* s) const { return strlen(s) == n && memcmp(p, s, n) == 0; }
+};
+
+// How SpawnAgents hands out path waypoints
+enum SpawnPathMode { SPAWN_PATH_RANDOM, SPAWN_PATH_SEQUENTIAL, SPAWN_PATH_FIXED, SPAWN_PATH_NEAREST };
+
+// A spawn distribution: positions uniform in [min, max), velocity components uniform in [velMin, velMax),
+// max speed uniform in [minSpeed, maxSpeed)
+struct ScenarioSpawn {
+    uint32_t count;
+    Vector2 min, max;
+    float minSpeed, maxSpeed;
+    Vector2 velMin = { -5.0f, -5.0f }, velMax = { 5.0f, 5.0f };
+    SpawnPathMode pathMode = SPAWN_PATH_RANDOM;
+    int pathIndex = 0;       // SPAWN_PATH_FIXED
+    float clearance = -1.0f; // >= 0: positions closer than this to an obstacle are redrawn (SpawnAgentsClear)
+};
+
+struct Scenario {
+    std::vector<Vector2> path;
+    std::vector<Vector2> obsCenters;
+    std::vector<float> obsRadii;
+    std::vector<Agent> agents;
+    uint64_t seed = 1;
+    double loadMs = 0;
+};
+
+// Reads the next whitespace separated token on the current line; false at end of line
+static bool NextToken(const char*& cur, const char* end, ScenarioToken& tok) {
+    while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r')) cur++;
+    if (cur >= end || *cur == '\n' || *cur == '#') return false;
+    tok.p = cur;
+    while (cur < end && *cur != ' ' && *cur != '\t' && *cur != '\r' && *cur != '\n') cur++;
+    tok.n = (size_t)(cur - tok.p);
+    return true;
+}
+
+// Decimal float parser working on an unterminated token (strtof would need a copy)
+static bool ParseFloatToken(const ScenarioToken& t, float& out) {
+    const char* p = t.p;
+    const char* e = t.p + t.n;
+    bool neg = false;
+    if (p < e && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+    double v = 0;
+    int digits = 0;
+    while (p < e && *p >= '0' && *p <= '9') { v = v * 10 + (*p++ - '0'); digits++; }
+    if (p < e && *p == '.') {
+        p++;
+        double scale = 0.1;
+        while (p < e && *p >= '0' && *p <= '9') { v += (*p++ - '0') * scale; scale *= 0.1; digits++; }
+    }
+    if (digits == 0) return false;
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool eneg = false;
+        if (p < e && (*p == '-' || *p == '+')) eneg = (*p++ == '-');
+        int ex = 0;
+        if (p >= e) return false;
+        while (p < e && *p >= '0' && *p <= '9' && ex < 400) ex = ex * 10 + (*p++ - '0');
+        v *= pow(10.0, eneg ? -ex : ex);
+    }
+    if (p != e) return false;
+    out = (float)(neg ? -v : v);
+    return true;
+}
+
+static bool ParseUIntToken(const ScenarioToken& t, uint64_t& out) {
+    if (t.n == 0 || t.n > 19) return false;
+    uint64_t v = 0;
+    for (size_t i = 0; i < t.n; ++i) {
+        if (t.p[i] < '0' || t.p[i] > '9') return false;
+        v = v * 10 + (uint64_t)(t.p[i] - '0');
+    }
+    out = v;
+    return true;
+}
+
+// The arguments of a spawn directive, count first (grammar above); the clearance stays -1 unless given
+static bool ParseSpawnArgs(const ScenarioToken* args, int argc, ScenarioSpawn& s) {
+    uint64_t count = 0;
+    float f[6];
+    if (argc < 5 || !ParseUIntToken(args[0], count) || count > 0xFFFFFFFFull) return false;
+    int i = 1, n = 0;
+    while (i < argc && n < 6 && ParseFloatToken(args[i], f[n])) { i++; n++; }
+    if (n != 4 && n != 6) return false;
+    s.count = (uint32_t)count;
+    s.min = { f[0], f[1] };
+    s.max = { f[2], f[3] };
+    s.minSpeed = n == 6 ? f[4] : 2.4f;
+    s.maxSpeed = n == 6 ? f[5] : 2.7f;
+    while (i < argc) {
+        const ScenarioToken& key = args[i++];
+        if (key.Is("vel") && argc - i >= 4) {
+            float v[4];
+            for (int k = 0; k < 4; ++k)
+                if (!ParseFloatToken(args[i++], v[k])) return false;
+            s.velMin = { v[0], v[1] };
+            s.velMax = { v[2], v[3] };
+        }
+        else if (key.Is("path") && i < argc) {
+            const ScenarioToken& mode = args[i++];
+            uint64_t index = 0;
+            if (mode.Is("random")) s.pathMode = SPAWN_PATH_RANDOM;
+            else if (mode.Is("sequential")) s.pathMode = SPAWN_PATH_SEQUENTIAL;
+            else if (mode.Is("nearest")) s.pathMode = SPAWN_PATH_NEAREST;
+            else if (mode.Is("fixed") && i < argc && ParseUIntToken(args[i++], index) && index <= 0x7FFFFFFFull) {
+                s.pathMode = SPAWN_PATH_FIXED;
+                s.pathIndex = (int)index;
+            }
+            else return false;
+        }
+        else if (key.Is("clear") && i < argc) {
+            if (!ParseFloatToken(args[i++], s.clearance) || !(s.clearance >= 0)) return false;
+        }
+        else return false;
+    }
+    return true;
+}
+
+// What one parser thread found in its byte range, merged in range order afterwards
+struct ScenarioPart {
+    std::vector<Vector2> waypoints, obsCenters;
+    std::vector<float> obsRadii;
+    std::vector<Agent> agents;
+    std::vector<ScenarioSpawn> spawns;
+    bool hasSeed = false;
+    uint64_t seed = 0;
+    const char* errorAt = nullptr;
+};
+
+static void ParseScenarioRange(const char* cur, const char* end, ScenarioPart& part) {
+    const int MAX_ARGS = 20;
+    ScenarioToken tok, args[MAX_ARGS];
+    while (cur < end) {
+        const char* lineStart = cur;
+        int argc = 0;
+        bool ok = true;
+        if (NextToken(cur, end, tok)) {
+            while (argc < MAX_ARGS && NextToken(cur, end, args[argc])) argc++;
+            ScenarioToken extra;
+            if (NextToken(cur, end, extra)) ok = false;
+            float f[MAX_ARGS];
+            uint64_t count = 0;
+            bool isSeed = tok.Is("seed"), isSpawn = tok.Is("spawn");
+            for (int i = isSeed ? 1 : 0; i < argc && ok && !isSpawn; ++i) ok = ParseFloatToken(args[i], f[i]);
+            if (ok && isSeed) ok = argc > 0 && ParseUIntToken(args[0], count);
+            // the optional path index must be a plain non-negative integer, never a float cast to int
+            uint64_t pathIndex = 0;
+            if (ok && tok.Is("agent") && argc == 6) ok = ParseUIntToken(args[5], pathIndex) && pathIndex <= 0x7FFFFFFFull;
+            if (ok) {
+                if (tok.Is("waypoint") && argc == 2) part.waypoints.push_back({ f[0], f[1] });
+                else if (tok.Is("obstacle") && argc == 3 && f[2] > 0) { part.obsCenters.push_back({ f[0], f[1] }); part.obsRadii.push_back(f[2]); }
+                else if (tok.Is("agent") && (argc == 5 || argc == 6)) {
+                    Agent a;
+                    a.pos = { f[0], f[1] };
+                    a.vel = { f[2], f[3] };
+                    a.acc = { 0,0 };
+                    a.maxSpeed = f[4];
+                    a.maxForce = 0.14f;
+                    a.pathIndex = argc == 6 ? (int)pathIndex : -1; // -1: assigned after the path is known
+                    a.color = SKYBLUE;
+                    part.agents.push_back(a);
+                }
+                else if (isSpawn) {
+                    ScenarioSpawn spawn;
+                    if (ParseSpawnArgs(args, argc, spawn)) part.spawns.push_back(spawn);
+                    else ok = false;
+                }
+                else if (isSeed && argc == 1) { part.hasSeed = true; part.seed = count; }
+                else ok = false;
+            }
+        }
+        if (!ok) { part.errorAt = lineStart; return; }
+        while (cur < end && *cur != '\n') cur++;
+        if (cur < end) cur++;
+    }
+}
+
+static const int SPAWN_MAX_ATTEMPTS = 16; // position draws per agent before a blocked one is kept anyway
+
+static int SpawnPathIndex(const ScenarioSpawn& s, const std::vector<Vector2>& path, size_t id, uint32_t r, Vector2 pos) {
+    int count = (int)path.size();
+    if (count == 0) return 0;
+    switch (s.pathMode) {
+    case SPAWN_PATH_SEQUENTIAL: return (int)(id % (size_t)count);
+    case SPAWN_PATH_FIXED: return std::max(0, std::min(s.pathIndex, count - 1));
+    case SPAWN_PATH_NEAREST: {
+        int best = 0;
+        for (int w = 1; w < count; ++w)
+            if (Length(Sub(path[w], pos)) < Length(Sub(path[best], pos))) best = w;
+        return best;
+    }
+    default: return (int)(r % (uint32_t)count);
+    }
+}
+
+// Fills out[0, s.count) in parallel; agent k only depends on (seed, firstIndex + k), never on the thread count.
+// A position for which blocked(pos) holds is redrawn from further RNG streams, up to SPAWN_MAX_ATTEMPTS draws;
+// returns how many agents are still blocked after that.
+template <typename Blocked>
+size_t SpawnAgents(Agent* out, size_t firstIndex, const ScenarioSpawn& s, uint64_t seed, const std::vector<Vector2>& path, const Blocked& blocked) {
+    std::atomic<size_t> stuck(0);
+    ParallelFor(s.count, [&](size_t b, size_t e, unsigned) {
+        const size_t BATCH = 256;
+        Random4 r0[BATCH], r1[BATCH];
+        size_t localStuck = 0;
+        for (size_t base = b; base < e; base += BATCH) {
+            size_t n = std::min(BATCH, e - base);
+            uint32_t id = (uint32_t)(firstIndex + base);
+            AgentRandomBatch(seed, id, n, 0, 0, r0);
+            AgentRandomBatch(seed, id, n, 0, 1, r1);
+            for (size_t k = 0; k < n; ++k) {
+                Agent& a = out[base + k];
+                a.pos = { s.min.x + (s.max.x - s.min.x) * RandomUnit(r0[k].v[0]), s.min.y + (s.max.y - s.min.y) * RandomUnit(r0[k].v[1]) };
+                for (uint32_t attempt = 1; blocked(a.pos); ++attempt) {
+                    if (attempt == SPAWN_MAX_ATTEMPTS) { localStuck++; break; }
+                    Random4 r = AgentRandom(seed, id + (uint32_t)k, 0, 1 + attempt);
+                    a.pos = { s.min.x + (s.max.x - s.min.x) * RandomUnit(r.v[0]), s.min.y + (s.max.y - s.min.y) * RandomUnit(r.v[1]) };
+                }
+                a.vel = { s.velMin.x + (s.velMax.x - s.velMin.x) * RandomUnit(r0[k].v[2]), s.velMin.y + (s.velMax.y - s.velMin.y) * RandomUnit(r0[k].v[3]) };
+                a.acc = { 0,0 };
+                a.maxSpeed = s.minSpeed + (s.maxSpeed - s.minSpeed) * RandomUnit(r1[k].v[0]);
+                a.maxForce = 0.14f;
+                a.pathIndex = SpawnPathIndex(s, path, firstIndex + base + k, r1[k].v[1], a.pos);
+                a.color = ((firstIndex + base + k) % 2 == 0) ? SKYBLUE : MAROON;
+            }
+        }
+        stuck += localStuck;
+    });
+    return stuck;
+}
+
+size_t SpawnAgents(Agent* out, size_t firstIndex, const ScenarioSpawn& s, uint64_t seed, const std::vector<Vector2>& path) {
+    return SpawnAgents(out, firstIndex, s, seed, path, [](Vector2) { return false; });
+}
+
+// defined with the obstacle bitmap further down
+size_t SpawnAgentsClear(Agent* out, size_t firstIndex, const ScenarioSpawn& s, uint64_t seed, const std::vector<Vector2>& path,
+    const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii, float worldW, float worldH);
+
+// Spawn directives without a `clear` of their own keep spawnClearance away from the obstacles (< 0: no filter)
+bool LoadScenario(const char* fileName, Scenario& out, std::string* error = nullptr, float spawnClearance = -1.0f) {
+    double t0 = NowSeconds();
+    MappedFile file;
+    if (!MapFile(fileName, file)) {
+        if (error) *error = std::string("cannot open ") + fileName;
+        return false;
+    }
+    const char* begin = (const char*)file.data;
+    const char* end = begin + file.size;
+
+    // line-aligned ranges, roughly 1 MB each so small files stay on one thread
+    std::vector<const char*> cuts(1, begin);
+    size_t parts = std::max<size_t>(1, std::min<size_t>(WorkerCount() * 4, file.size / (1 << 20)));
+    for (size_t i = 1; i < parts; ++i) {
+        const char* c = begin + file.size * i / parts;
+        if (c < cuts.back()) c = cuts.back();
+        while (c < end && c[-1] != '\n') c++;
+        cuts.push_back(c);
+    }
+    cuts.push_back(end);
+    std::vector<ScenarioPart> results(parts);
+    ParallelFor(parts, [&](size_t b, size_t e, unsigned) {
+        for (size_t i = b; i < e; ++i) ParseScenarioRange(cuts[i], cuts[i + 1], results[i]);
+    }, 1);
+
+    Scenario sc;
+    std::vector<size_t> agentOffset(parts + 1, 0);
+    std::vector<ScenarioSpawn> spawns;
+    for (size_t i = 0; i < parts; ++i) {
+        const ScenarioPart& p = results[i];
+        if (p.errorAt) {
+            if (error) {
+                size_t line = 1 + (size_t)std::count(begin, p.errorAt, '\n');
+                const char* eol = p.errorAt;
+                while (eol < end && *eol != '\n' && eol - p.errorAt < 80) eol++;
+                *error = std::string(fileName) + ":" + std::to_string(line) + ": bad directive '" + std::string(p.errorAt, eol) + "'";
+            }
+            UnmapFile(file);
+            return false;
+        }
+        sc.path.insert(sc.path.end(), p.waypoints.begin(), p.waypoints.end());
+        sc.obsCenters.insert(sc.obsCenters.end(), p.obsCenters.begin(), p.obsCenters.end());
+        sc.obsRadii.insert(sc.obsRadii.end(), p.obsRadii.begin(), p.obsRadii.end());
+        spawns.insert(spawns.end(), p.spawns.begin(), p.spawns.end());
+        if (p.hasSeed) sc.seed = p.seed;
+        agentOffset[i + 1] = agentOffset[i] + p.agents.size();
+    }
+    UnmapFile(file);
+
+    size_t explicitCount = agentOffset[parts];
+    size_t total = explicitCount;
+    for (const ScenarioSpawn& s : spawns) total += s.count;
+    sc.agents.resize(total);
+    int pathCount = (int)sc.path.size();
+    ParallelFor(parts, [&](size_t b, size_t e, unsigned) {
+        for (size_t i = b; i < e; ++i) {
+            if (!results[i].agents.empty())
+                memcpy(&sc.agents[agentOffset[i]], results[i].agents.data(), results[i].agents.size() * sizeof(Agent));
+        }
+    }, 1);
+
+    // all obstacles are known by now, wherever they appear in the file
+    size_t next = explicitCount;
+    for (ScenarioSpawn s : spawns) {
+        if (s.clearance < 0) s.clearance = spawnClearance;
+        SpawnAgentsClear(&sc.agents[next], next, s, sc.seed, sc.path, sc.obsCenters, sc.obsRadii, s.max.x, s.max.y);
+        next += s.count;
+    }
+    ParallelFor(total, [&](size_t b, size_t e, unsigned) {
+        for (size_t i = b; i < e; ++i) {
+            Agent& a = sc.agents[i];
+            if (a.pathIndex < 0 || a.pathIndex >= pathCount) a.pathIndex = pathCount > 0 ? (int)(i % (size_t)pathCount) : 0;
+            a.color = (i % 2 == 0) ? SKYBLUE : MAROON;
+        }
+    });
+
+    sc.loadMs = (NowSeconds() - t0) * 1000.0;
+    out = std::move(sc);
+    return true;
+}
+
+// ---------- Live state feed ----------
+// Copies pos/vel of every agent into the next shared-memory slot (see state_feed.h for the reader side)
+void PublishStateFeed(StateFeedWriter& feed, uint64_t step, const std::vector<Agent>& agents) {
+    if (!feed.base) return;
+    uint32_t maxAgents = StateFeedHeaderOf(feed)->maxAgents;
+    StateFeedSlot* slot = StateFeedBeginWrite(feed);
+    uint32_t n = agents.size() < maxAgents ? (uint32_t)agents.size() : maxAgents;
+    float* px = StateFeedColumn(slot, maxAgents, 0);
+    float* py = StateFeedColumn(slot, maxAgents, 1);
+    float* vx = StateFeedColumn(slot, maxAgents, 2);
+    float* vy = StateFeedColumn(slot, maxAgents, 3);
+    for (uint32_t i = 0; i < n; ++i) {
+        const Agent& a = agents[i];
+        px[i] = a.pos.x; py[i] = a.pos.y; vx[i] = a.vel.x; vy[i] = a.vel.y;
+    }
+    slot->agentCount = n;
+    slot->totalAgents = (uint32_t)agents.size();
+    slot->step = step;
+    StateFeedEndWrite(feed, slot);
+}
+
+// ---------- Input recording ----------
+// Everything the sim reads from the keyboard/mouse in one step. Interactive runs poll it from raylib and can
+// log it; --replay-input feeds a log back headlessly, so a session becomes a repeatable benchmark.
+static const int INPUT_KEYS[] = {
+    KEY_TAB, KEY_ONE, KEY_TWO, KEY_THREE, KEY_FOUR, KEY_FIVE, KEY_SIX, KEY_D, KEY_P, KEY_B, KEY_F5, KEY_F6, KEY_F9, KEY_W, KEY_F, KEY_C, KEY_N, KEY_T, KEY_H
+};
+static const int INPUT_KEY_COUNT = (int)(sizeof(INPUT_KEYS) / sizeof(INPUT_KEYS[0]));
+static_assert(sizeof(INPUT_KEYS) / sizeof(INPUT_KEYS[0]) <= 32, "FrameInput::pressed holds 32 keys");
+
+struct FrameInput {
+    uint32_t pressed = 0; // bit i set when INPUT_KEYS[i] was pressed this step
+    Vector2 mouse = { 0,0 };
+    float gridScale = 0; // neighbour-grid cell scale the tuner switched to before this step, 0 = unchanged
+    int8_t loadLevel = -1; // LoadLevel the shedder switched to before this step, -1 = unchanged
+    std::vector<uint8_t> control; // state-changing control requests run before this step (see ControlTargets::journal)
+    bool Pressed(int key) const {
+        for (int i = 0; i < INPUT_KEY_COUNT; ++i)
+            if (INPUT_KEYS[i] == key) return (pressed >> i) & 1;
+        return false;
+    }
+};
+
+FrameInput PollFrameInput() {
+    FrameInput in;
+    for (int i = 0; i < INPUT_KEY_COUNT; ++i)
+        if (IsKeyPressed(INPUT_KEYS[i])) in.pressed |= 1u << i;
+    in.mouse = GetMousePosition();
+    return in;
+}
+
+// Log layout: InputLogHeader, then one record per step: a flags byte, the key mask if INPUT_HAS_KEYS,
+// the upper key mask if INPUT_HAS_HIGH_KEYS, the mouse position if INPUT_HAS_MOUSE, the grid scale if
+// INPUT_HAS_GRID_SCALE, the load level if INPUT_HAS_LOAD_LEVEL, a u32 byte count and the control requests if
+// INPUT_HAS_CONTROL (unchanged input costs a single byte)
+static const char INPUT_MAGIC[8] = { 'S','T','E','E','R','I','N','P' };
+static const uint8_t INPUT_HAS_KEYS = 1, INPUT_HAS_MOUSE = 2, INPUT_HAS_HIGH_KEYS = 4; // keys 0-15 / mouse / keys 16-31
+static const uint8_t INPUT_HAS_GRID_SCALE = 8, INPUT_HAS_LOAD_LEVEL = 16, INPUT_HAS_CONTROL = 32;
+// Record flags allowed by each version (index = version); every version added one, and older logs still replay
+static const uint8_t INPUT_VERSION_FLAGS[] = {
+    0,
+    INPUT_HAS_KEYS | INPUT_HAS_MOUSE,
+    INPUT_HAS_KEYS | INPUT_HAS_MOUSE | INPUT_HAS_HIGH_KEYS,
+    INPUT_HAS_KEYS | INPUT_HAS_MOUSE | INPUT_HAS_HIGH_KEYS | INPUT_HAS_GRID_SCALE,
+    INPUT_HAS_KEYS | INPUT_HAS_MOUSE | INPUT_HAS_HIGH_KEYS | INPUT_HAS_GRID_SCALE | INPUT_HAS_LOAD_LEVEL,
+    INPUT_HAS_KEYS | INPUT_HAS_MOUSE | INPUT_HAS_HIGH_KEYS | INPUT_HAS_GRID_SCALE | INPUT_HAS_LOAD_LEVEL | INPUT_HAS_CONTROL,
+};
+static const uint32_t INPUT_VERSION = (uint32_t)(sizeof(INPUT_VERSION_FLAGS) / sizeof(INPUT_VERSION_FLAGS[0])) - 1;
+
+struct InputLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t seed;
+    uint64_t worldHash; // initial agents/path/obstacles, so replays against a different world are caught
+    Vector2 initialMouse;
+};
+
+struct InputRecorder {
+    FILE* file = nullptr;
+    Vector2 lastMouse = { 0,0 };
+    std::vector<uint8_t> buffer;
+    bool writeFailed = false; // a write came up short (disk full...); later steps are not logged
+};
+
+struct InputReplay {
+    InputLogHeader header = {};
+    std::vector<uint8_t> data;
+    size_t pos = 0;
+    Vector2 mouse = { 0,0 };
+};
+
+static uint64_t HashBytes(uint64_t h, const void* data, size_t n) { // FNV-1a
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; ++i) h = (h ^ p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+uint64_t HashWorld(const std::vector<Agent>& agents, const std::vector<Vector2>& path, const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    h = HashBytes(h, agents.data(), agents.size() * sizeof(Agent));
+    h = HashBytes(h, path.data(), path.size() * sizeof(Vector2));
+    h = HashBytes(h, obsCenters.data(), obsCenters.size() * sizeof(Vector2));
+    return HashBytes(h, obsRadii.data(), obsRadii.size() * sizeof(float));
+}
+
+bool StartInputRecording(InputRecorder& rec, const char* fileName, uint32_t seed, uint64_t worldHash, Vector2 initialMouse) {
+    rec.file = fopen(fileName, "wb");
+    if (!rec.file) return false;
+    InputLogHeader h;
+    memcpy(h.magic, INPUT_MAGIC, sizeof(h.magic));
+    h.version = INPUT_VERSION;
+    h.seed = seed;
+    h.worldHash = worldHash;
+    h.initialMouse = initialMouse;
+    if (fwrite(&h, sizeof(h), 1, rec.file) != 1) {
+        fclose(rec.file);
+        rec.file = nullptr;
+        return false;
+    }
+    rec.lastMouse = initialMouse;
+    rec.buffer.clear();
+    rec.writeFailed = false;
+    return true;
+}
+
+void RecordInput(InputRecorder& rec, const FrameInput& in) {
+    if (!rec.file || rec.writeFailed) return;
+    uint8_t flags = ((in.pressed & 0xFFFFu) ? INPUT_HAS_KEYS : 0) | ((in.pressed >> 16) ? INPUT_HAS_HIGH_KEYS : 0)
+        | ((in.mouse.x != rec.lastMouse.x || in.mouse.y != rec.lastMouse.y) ? INPUT_HAS_MOUSE : 0)
+        | (in.gridScale > 0 ? INPUT_HAS_GRID_SCALE : 0) | (in.loadLevel >= 0 ? INPUT_HAS_LOAD_LEVEL : 0)
+        | (!in.control.empty() ? INPUT_HAS_CONTROL : 0);
+    rec.buffer.push_back(flags);
+    if (flags & INPUT_HAS_KEYS) {
+        rec.buffer.push_back((uint8_t)in.pressed);
+        rec.buffer.push_back((uint8_t)(in.pressed >> 8));
+    }
+    if (flags & INPUT_HAS_HIGH_KEYS) {
+        rec.buffer.push_back((uint8_t)(in.pressed >> 16));
+        rec.buffer.push_back((uint8_t)(in.pressed >> 24));
+    }
+    if (flags & INPUT_HAS_MOUSE) {
+        const uint8_t* m = (const uint8_t*)&in.mouse;
+        rec.buffer.insert(rec.buffer.end(), m, m + sizeof(Vector2));
+        rec.lastMouse = in.mouse;
+    }
+    if (flags & INPUT_HAS_GRID_SCALE) {
+        const uint8_t* g = (const uint8_t*)&in.gridScale;
+        rec.buffer.insert(rec.buffer.end(), g, g + sizeof(float));
+    }
+    if (flags & INPUT_HAS_LOAD_LEVEL) rec.buffer.push_back((uint8_t)in.loadLevel);
+    if (flags & INPUT_HAS_CONTROL) {
+        uint32_t bytes = (uint32_t)in.control.size();
+        const uint8_t* n = (const uint8_t*)&bytes;
+        rec.buffer.insert(rec.buffer.end(), n, n + sizeof(bytes));
+        rec.buffer.insert(rec.buffer.end(), in.control.begin(), in.control.end());
+    }
+    if (rec.buffer.size() >= 4096) {
+        if (fwrite(rec.buffer.data(), 1, rec.buffer.size(), rec.file) != rec.buffer.size()) rec.writeFailed = true;
+        rec.buffer.clear();
+    }
+}
+
+// Flushes the buffered records and closes the log; false if any write failed and the log is truncated
+bool StopInputRecording(InputRecorder& rec) {
+    if (!rec.file) return true;
+    bool ok = !rec.writeFailed
+        && (rec.buffer.empty() || fwrite(rec.buffer.data(), 1, rec.buffer.size(), rec.file) == rec.buffer.size());
+    ok = (fclose(rec.file) == 0) && ok;
+    rec.file = nullptr;
+    rec.buffer.clear();
+    return ok;
+}
+
+bool OpenInputReplay(InputReplay& r, const char* fileName) {
+    FILE* f = fopen(fileName, "rb");
+    if (!f) return false;
+    bool ok = fread(&r.header, sizeof(r.header), 1, f) == 1
+        && memcmp(r.header.magic, INPUT_MAGIC, sizeof(INPUT_MAGIC)) == 0
+        && r.header.version >= 1 && r.header.version <= INPUT_VERSION;
+    r.data.clear();
+    uint8_t chunk[4096];
+    size_t n;
+    while (ok && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) r.data.insert(r.data.end(), chunk, chunk + n);
+    fclose(f);
+    r.pos = 0;
+    r.mouse = r.header.initialMouse;
+    return ok;
+}
+
+bool NextInput(InputReplay& r, FrameInput& in) {
+    if (r.pos >= r.data.size()) return false;
+    uint8_t flags = r.data[r.pos++];
+    if (flags & ~INPUT_VERSION_FLAGS[r.header.version]) {
+        TraceLog(LOG_WARNING, "Input log: unknown record flags 0x%02x for version %u at byte %zu", flags, r.header.version, r.pos - 1);
+        r.pos = r.data.size();
+        return false;
+    }
+    size_t need = ((flags & INPUT_HAS_KEYS) ? 2 : 0) + ((flags & INPUT_HAS_HIGH_KEYS) ? 2 : 0) + ((flags & INPUT_HAS_MOUSE) ? sizeof(Vector2) : 0)
+        + ((flags & INPUT_HAS_GRID_SCALE) ? sizeof(float) : 0) + ((flags & INPUT_HAS_LOAD_LEVEL) ? 1 : 0);
+    if (r.data.size() - r.pos < need) return false; // truncated log
+    in.pressed = 0;
+    if (flags & INPUT_HAS_KEYS) {
+        in.pressed = (uint32_t)r.data[r.pos] | ((uint32_t)r.data[r.pos + 1] << 8);
+        r.pos += 2;
+    }
+    if (flags & INPUT_HAS_HIGH_KEYS) {
+        in.pressed |= ((uint32_t)r.data[r.pos] << 16) | ((uint32_t)r.data[r.pos + 1] << 24);
+        r.pos += 2;
+    }
+    if (flags & INPUT_HAS_MOUSE) {
+        memcpy(&r.mouse, &r.data[r.pos], sizeof(Vector2));
+        r.pos += sizeof(Vector2);
+    }
+    in.mouse = r.mouse;
+    in.gridScale = 0;
+    if (flags & INPUT_HAS_GRID_SCALE) {
+        memcpy(&in.gridScale, &r.data[r.pos], sizeof(float));
+        r.pos += sizeof(float);
+    }
+    in.loadLevel = (flags & INPUT_HAS_LOAD_LEVEL) ? (int8_t)r.data[r.pos++] : -1;
+    in.control.clear();
+    if (flags & INPUT_HAS_CONTROL) {
+        uint32_t bytes;
+        if (r.data.size() - r.pos < sizeof(bytes)) return false;
+        memcpy(&bytes, &r.data[r.pos], sizeof(bytes));
+        r.pos += sizeof(bytes);
+        if (r.data.size() - r.pos < bytes) return false;
+        in.control.assign(r.data.begin() + r.pos, r.data.begin() + r.pos + bytes);
+        r.pos += bytes;
+    }
+    return true;
+}
+
+// ---------- Neighbour grid & spatial queries ----------
+// Uniform grid over the agents' bounding box, agent indices counting-sorted by cell. StepAgents rebuilds it at
+// the start of every step; agents move at most `slack` px afterwards, so every lookup widens its search by
+// slack and then tests live positions. Agent handles are indices into the agents vector: valid until agents are
+// added or removed.
+static const uint32_t AGENT_NONE = 0xFFFFFFFFu;
+
+struct MassNode {
+    uint32_t count;
+    Vector2 center; // centre of mass at build time
+};
+
+struct GridLevel {
+    int cols = 0, rows = 0;
+    std::vector<MassNode> nodes;
+};
+
+// Periodic world: positions live in [min, min + size) on both axes and every separation is taken to the nearest
+// image. Disabled, the world is open and the edge wrap is a plain teleport.
+struct WorldWrap {
+    bool enabled = false;
+    Vector2 min = { 0,0 }, size = { 0,0 };
+};
+
+// Nearest-image version of a separation vector
+static Vector2 MinImage(Vector2 d, const WorldWrap& w) {
+    if (!w.enabled) return d;
+    if (d.x > 0.5f * w.size.x) d.x -= w.size.x; else if (d.x < -0.5f * w.size.x) d.x += w.size.x;
+    if (d.y > 0.5f * w.size.y) d.y -= w.size.y; else if (d.y < -0.5f * w.size.y) d.y += w.size.y;
+    return d;
+}
+
+static const float WORLD_EDGE_MARGIN = 60.0f; // agents leave the screen by this much before they wrap
+
+// Edge wrap after integration: the open world teleports to the opposite margin, the periodic one keeps the
+// offset so motion stays continuous across the seam
+static void WrapWorldPosition(Vector2& p, float worldW, float worldH, const WorldWrap& w) {
+    if (w.enabled) {
+        if (p.x < w.min.x) p.x += w.size.x; else if (p.x >= w.min.x + w.size.x) p.x -= w.size.x;
+        if (p.y < w.min.y) p.y += w.size.y; else if (p.y >= w.min.y + w.size.y) p.y -= w.size.y;
+        return;
+    }
+    if (p.x < -WORLD_EDGE_MARGIN) p.x = worldW + WORLD_EDGE_MARGIN;
+    if (p.x > worldW + WORLD_EDGE_MARGIN) p.x = -WORLD_EDGE_MARGIN;
+    if (p.y < -WORLD_EDGE_MARGIN) p.y = worldH + WORLD_EDGE_MARGIN;
+    if (p.y > worldH + WORLD_EDGE_MARGIN) p.y = -WORLD_EDGE_MARGIN;
+}
+
+struct NeighborGrid {
+    float cellSize = 1, invCell = 1;
+    Vector2 origin = { 0,0 };
+    int cols = 0, rows = 0;
+    float slack = 0;
+    uint32_t agentCount = 0;
+    std::vector<uint32_t> cellStart; // cols*rows + 1 offsets into indices
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> agentCell; // cell of each agent at the build, GRID_JUMPED once NoteGridJump moved it
+    std::vector<uint32_t> jumped;    // (cell, agent) pairs added by NoteGridJump since the build
+    std::vector<GridLevel> levels;   // mass pyramid, only built for far-field separation (level 0 = the cells)
+    WorldWrap wrap;                  // periodic grids tile exactly the wrapped world
+};
+
+static const uint32_t GRID_JUMPED = 0xFFFFFFFFu;
+
+static int GridCoord(float v, float origin, float inv, int count) {
+    float f = (v - origin) * inv;
+    if (!(f > 0)) return 0; // also catches NaN
+    return f >= (float)(count - 1) ? count - 1 : (int)f;
+}
+
+// With wrap enabled the grid covers the wrapped world instead of the agents' bounding box, in whole cells
+// (the last column and row absorb the remainder), so a cell range that runs off one edge continues at the other.
+void BuildNeighborGrid(NeighborGrid& g, const std::vector<Agent>& agents, float cellSize, float slack, const WorldWrap& wrap = WorldWrap()) {
+    size_t n = agents.size();
+    g.agentCount = (uint32_t)n;
+    g.slack = slack;
+    g.indices.resize(n);
+    g.agentCell.resize(n);
+    g.levels.clear();
+    g.jumped.clear();
+    g.wrap = wrap;
+    Vector2 lo = { 0,0 }, hi = { 0,0 };
+    if (wrap.enabled) {
+        lo = wrap.min;
+        hi = Add(wrap.min, wrap.size);
+    }
+    else {
+        bool any = false;
+        for (const Agent& a : agents) {
+            if (!(a.pos.x == a.pos.x && a.pos.y == a.pos.y)) continue; // NaN positions land in cell 0
+            if (!any) { lo = hi = a.pos; any = true; continue; }
+            lo.x = std::min(lo.x, a.pos.x); lo.y = std::min(lo.y, a.pos.y);
+            hi.x = std::max(hi.x, a.pos.x); hi.y = std::max(hi.y, a.pos.y);
+        }
+    }
+    float cs = std::max(cellSize, 1.0f);
+    // sparse worlds get bigger cells so the table stays O(agents)
+    while (((double)(hi.x - lo.x) / cs + 1) * ((double)(hi.y - lo.y) / cs + 1) > 2.0 * (double)n + 64) cs *= 2;
+    g.cellSize = cs;
+    g.invCell = 1.0f / cs;
+    g.origin = lo;
+    if (wrap.enabled) {
+        g.cols = std::max(1, (int)((hi.x - lo.x) * g.invCell));
+        g.rows = std::max(1, (int)((hi.y - lo.y) * g.invCell));
+    }
+    else {
+        g.cols = (int)((hi.x - lo.x) * g.invCell) + 1;
+        g.rows = (int)((hi.y - lo.y) * g.invCell) + 1;
+    }
+    g.cellStart.assign((size_t)g.cols * g.rows + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t c = (uint32_t)(GridCoord(agents[i].pos.y, lo.y, g.invCell, g.rows) * g.cols + GridCoord(agents[i].pos.x, lo.x, g.invCell, g.cols));
+        g.agentCell[i] = c;
+        g.cellStart[c + 1]++;
+    }
+    for (size_t c = 1; c < g.cellStart.size(); ++c) g.cellStart[c] += g.cellStart[c - 1];
+    for (size_t i = 0; i < n; ++i) g.indices[g.cellStart[g.agentCell[i]]++] = (uint32_t)i;
+    for (size_t c = g.cellStart.size() - 1; c > 0; --c) g.cellStart[c] = g.cellStart[c - 1]; // undo the cursor shift
+    g.cellStart[0] = 0;
+}
+
+// The open-world edge wrap teleports an agent across the world, far beyond the slack that covers ordinary motion.
+// Moves agent i's grid entry to the cell of its new position so queries after the jump (later agents of the same
+// step, or the spatial queries between steps) still find it. Periodic grids never need this.
+static void NoteGridJump(NeighborGrid& g, uint32_t i, Vector2 pos) {
+    if (g.cols == 0 || g.wrap.enabled || i >= g.agentCount) return;
+    g.agentCell[i] = GRID_JUMPED;
+    g.jumped.push_back((uint32_t)(GridCoord(pos.y, g.origin.y, g.invCell, g.rows) * g.cols + GridCoord(pos.x, g.origin.x, g.invCell, g.cols)));
+    g.jumped.push_back(i);
+}
+
+// Calls fn(index) for every agent whose cell overlaps the box [min - slack, max + slack]; callers test exactly
+template <typename Fn>
+void ForEachGridCandidate(const NeighborGrid& g, Vector2 min, Vector2 max, const Fn& fn) {
+    if (g.cols == 0) return;
+    int x0 = GridCoord(min.x - g.slack, g.origin.x, g.invCell, g.cols), x1 = GridCoord(max.x + g.slack, g.origin.x, g.invCell, g.cols);
+    int y0 = GridCoord(min.y - g.slack, g.origin.y, g.invCell, g.rows), y1 = GridCoord(max.y + g.slack, g.origin.y, g.invCell, g.rows);
+    if (g.jumped.empty()) {
+        for (int y = y0; y <= y1; ++y) {
+            const uint32_t* start = &g.cellStart[(size_t)y * g.cols];
+            for (uint32_t k = start[x0]; k < start[x1 + 1]; ++k) fn(g.indices[k]); // cells x0..x1 of a row are contiguous
+        }
+        return;
+    }
+    for (int y = y0; y <= y1; ++y) {
+        const uint32_t* start = &g.cellStart[(size_t)y * g.cols];
+        for (uint32_t k = start[x0]; k < start[x1 + 1]; ++k)
+            if (g.agentCell[g.indices[k]] != GRID_JUMPED) fn(g.indices[k]);
+    }
+    for (size_t k = 0; k < g.jumped.size(); k += 2) {
+        int x = (int)(g.jumped[k] % (uint32_t)g.cols), y = (int)(g.jumped[k] / (uint32_t)g.cols);
+        if (x >= x0 && x <= x1 && y >= y0 && y <= y1) fn(g.jumped[k + 1]);
+    }
+}
+
+// Cells covering [lo, hi] on one axis of a periodic grid as up to two ranges (first, last pairs in out);
+// returns the number of ranges. A span that wraps onto cells it already covers collapses to the whole axis.
+static int WrappedCellRanges(float lo, float hi, float origin, float period, float inv, int count, int* out) {
+    if (!(hi - lo < period)) { out[0] = 0; out[1] = count - 1; return 1; }
+    float end = origin + period;
+    int n = 0;
+    if (lo < origin) { out[n++] = GridCoord(lo + period, origin, inv, count); out[n++] = count - 1; lo = origin; }
+    if (hi >= end) { out[n++] = 0; out[n++] = GridCoord(hi - period, origin, inv, count); hi = end; }
+    if (lo <= hi) { out[n++] = GridCoord(lo, origin, inv, count); out[n++] = GridCoord(hi, origin, inv, count); }
+    if (n == 4 && std::max(out[0], out[2]) <= std::min(out[1], out[3]) + 1) { out[0] = 0; out[1] = count - 1; return 1; }
+    return n / 2;
+}
+
+// ForEachGridCandidate that also sees across the edges of a periodic grid: calls fn(index, wrapped), where
+// wrapped says the box touches an edge cell and separations to that candidate must go through MinImage.
+// Queries away from the edges take the plain path and pay nothing for the wrap.
+template <typename Fn>
+void ForEachGridNeighbor(const NeighborGrid& g, Vector2 min, Vector2 max, const Fn& fn) {
+    if (g.cols == 0) return;
+    if (!g.wrap.enabled) {
+        ForEachGridCandidate(g, min, max, [&](uint32_t j) { fn(j, false); });
+        return;
+    }
+    int xr[4], yr[4];
+    int nx = WrappedCellRanges(min.x - g.slack, max.x + g.slack, g.origin.x, g.wrap.size.x, g.invCell, g.cols, xr);
+    int ny = WrappedCellRanges(min.y - g.slack, max.y + g.slack, g.origin.y, g.wrap.size.y, g.invCell, g.rows, yr);
+    // an agent in an edge cell may have wrapped since the build, so min-image those even if the box doesn't cross
+    bool edge = nx > 1 || ny > 1 || xr[0] == 0 || xr[1] == g.cols - 1 || yr[0] == 0 || yr[1] == g.rows - 1;
+    for (int ry = 0; ry < ny; ++ry)
+        for (int y = yr[2 * ry]; y <= yr[2 * ry + 1]; ++y) {
+            const uint32_t* start = &g.cellStart[(size_t)y * g.cols];
+            for (int rx = 0; rx < nx; ++rx)
+                for (uint32_t k = start[xr[2 * rx]]; k < start[xr[2 * rx + 1] + 1]; ++k) fn(g.indices[k], edge);
+        }
+}
+
+// Separation() over grid candidates instead of every agent
+// `tested` / `accepted` (optional) are incremented by the candidate pairs looked at / found inside the radius
+Vector2 SeparationGrid(const Agent& self, const std::vector<Agent>& agents, const NeighborGrid& grid, float separationRadius, float strength,
+    uint64_t* tested = nullptr, uint64_t* accepted = nullptr) {
+    Vector2 steer = { 0,0 };
+    int count = 0;
+    uint32_t seen = 0;
+    Vector2 r = { separationRadius, separationRadius };
+    ForEachGridNeighbor(grid, Sub(self.pos, r), Add(self.pos, r), [&](uint32_t j, bool wrapped) {
+        const Agent& other = agents[j];
+        if (&other == &self) return;
+        seen++;
+        Vector2 diff = Sub(self.pos, other.pos);
+        if (wrapped) diff = MinImage(diff, grid.wrap);
+        float d = Length(diff);
+        if (d > 0 && d < separationRadius) {
+            Vector2 away = Normalize(diff);
+            float factor = (separationRadius - d) / separationRadius;
+            steer = Add(steer, Scale(away, factor));
+            count++;
+        }
+    });
+    if (tested) *tested += seen;
+    if (accepted) *accepted += (uint64_t)count;
+    if (count > 0) steer = Scale(steer, 1.0f / (float)count);
+    if (Length(steer) < 0.0001f) return { 0,0 };
+    steer = Normalize(steer);
+    return Scale(steer, strength);
+}
+
+// Far-field separation: a quadtree over the grid. Level 0 holds each cell's agent count and centre of mass,
+// every level above merges 2x2 nodes of the one below. A node that is small next to its distance from the agent
+// (size < theta * distance) and lies wholly inside the separation radius pushes like `count` agents sitting at
+// its centre of mass; everything else is opened, down to exact pairs in the level-0 cells.
+static const float FAR_FIELD_CELLS_PER_RADIUS = 16.0f; // level-0 cell = separationRadius / this
+// Grid columns and rows are ints, so halving them reaches a single node after at most 31 levels above level 0
+static const int MASS_PYRAMID_MAX_LEVELS = 32;
+static_assert(MASS_PYRAMID_MAX_LEVELS >= (int)sizeof(int) * 8, "a pyramid over an int-sized grid can have this many levels");
+void BuildMassPyramid(NeighborGrid& g, const std::vector<Agent>& agents) {
+    g.levels.clear();
+    if (g.cols == 0) return;
+    g.levels.emplace_back();
+    GridLevel& base = g.levels.back();
+    base.cols = g.cols;
+    base.rows = g.rows;
+    base.nodes.resize((size_t)g.cols * g.rows);
+    ParallelFor(base.nodes.size(), [&](size_t b, size_t e, unsigned) {
+        for (size_t c = b; c < e; ++c) {
+            double sx = 0, sy = 0;
+            for (uint32_t k = g.cellStart[c]; k < g.cellStart[c + 1]; ++k) {
+                sx += agents[g.indices[k]].pos.x;
+                sy += agents[g.indices[k]].pos.y;
+            }
+            uint32_t n = g.cellStart[c + 1] - g.cellStart[c];
+            base.nodes[c] = { n, n ? Vector2{ (float)(sx / n), (float)(sy / n) } : Vector2{ 0,0 } };
+        }
+    }, 4096);
+    while (g.levels.back().cols > 1 || g.levels.back().rows > 1) {
+        const GridLevel& below = g.levels.back();
+        GridLevel up;
+        up.cols = (below.cols + 1) / 2;
+        up.rows = (below.rows + 1) / 2;
+        up.nodes.resize((size_t)up.cols * up.rows);
+        for (int y = 0; y < up.rows; ++y)
+            for (int x = 0; x < up.cols; ++x) {
+                uint32_t n = 0;
+                double sx = 0, sy = 0;
+                for (int cy = 2 * y; cy < std::min(2 * y + 2, below.rows); ++cy)
+                    for (int cx = 2 * x; cx < std::min(2 * x + 2, below.cols); ++cx) {
+                        const MassNode& m = below.nodes[(size_t)cy * below.cols + cx];
+                        n += m.count;
+                        sx += (double)m.center.x * m.count;
+                        sy += (double)m.center.y * m.count;
+                    }
+                up.nodes[(size_t)y * up.cols + x] = { n, n ? Vector2{ (float)(sx / n), (float)(sy / n) } : Vector2{ 0,0 } };
+            }
+        g.levels.push_back(std::move(up));
+    }
+}
+
+// Separation() with distant clusters taken from the pyramid; theta = 0 is exact. `interactions`, if given, is
+// increased by the number of pairs plus clusters evaluated. Agents that jumped since the build (NoteGridJump) are
+// tested exactly and skipped in their old cells; the pyramid's node masses still hold them where they were.
+Vector2 SeparationFarField(const Agent& self, const std::vector<Agent>& agents, const NeighborGrid& g, float separationRadius, float strength,
+    float theta, size_t* interactions = nullptr) {
+    Vector2 steer = { 0,0 };
+    uint32_t count = 0;
+    size_t evaluated = 0;
+    struct NodeRef { int level, x, y; };
+    // depth first: opening a node replaces it with up to 4 children, so each level adds at most 3 pending nodes
+    NodeRef stack[3 * MASS_PYRAMID_MAX_LEVELS + 1];
+    int top = 0;
+    auto pair = [&](const Agent& other) {
+        if (&other == &self) return;
+        evaluated++;
+        Vector2 diff = Sub(self.pos, other.pos);
+        float d = Length(diff);
+        if (d > 0 && d < separationRadius) {
+            steer = Add(steer, Scale(Normalize(diff), (separationRadius - d) / separationRadius));
+            count++;
+        }
+    };
+    for (size_t k = 1; k < g.jumped.size(); k += 2) pair(agents[g.jumped[k]]);
+    if (!g.levels.empty()) stack[top++] = { (int)g.levels.size() - 1, 0, 0 };
+    while (top > 0) {
+        NodeRef n = stack[--top];
+        const GridLevel& level = g.levels[n.level];
+        const MassNode& node = level.nodes[(size_t)n.y * level.cols + n.x];
+        if (node.count == 0) continue;
+        float size = g.cellSize * (float)(1u << n.level);
+        Vector2 lo = { g.origin.x + n.x * size, g.origin.y + n.y * size };
+        float dx = std::max(std::max(lo.x - self.pos.x, self.pos.x - (lo.x + size)), 0.0f);
+        float dy = std::max(std::max(lo.y - self.pos.y, self.pos.y - (lo.y + size)), 0.0f);
+        float nearest = sqrtf(dx * dx + dy * dy);
+        if (nearest - g.slack >= separationRadius) continue; // nothing in this node can be close enough
+        float fx = std::max(fabsf(self.pos.x - lo.x), fabsf(self.pos.x - (lo.x + size)));
+        float fy = std::max(fabsf(self.pos.y - lo.y), fabsf(self.pos.y - (lo.y + size)));
+        Vector2 diff = Sub(self.pos, node.center);
+        float d = Length(diff);
+        if (nearest > 0 && size < theta * d && sqrtf(fx * fx + fy * fy) + g.slack < separationRadius) {
+            evaluated++;
+            steer = Add(steer, Scale(Normalize(diff), node.count * (separationRadius - d) / separationRadius));
+            count += node.count;
+            continue;
+        }
+        if (n.level == 0) {
+            size_t c = (size_t)n.y * g.cols + n.x;
+            for (uint32_t k = g.cellStart[c]; k < g.cellStart[c + 1]; ++k)
+                if (g.agentCell[g.indices[k]] != GRID_JUMPED) pair(agents[g.indices[k]]);
+            continue;
+        }
+        const GridLevel& below = g.levels[n.level - 1];
+        for (int cy = 2 * n.y; cy < std::min(2 * n.y + 2, below.rows); ++cy)
+            for (int cx = 2 * n.x; cx < std::min(2 * n.x + 2, below.cols); ++cx) stack[top++] = { n.level - 1, cx, cy };
+    }
+    if (interactions) *interactions += evaluated;
+    if (count > 0) steer = Scale(steer, 1.0f / (float)count);
+    if (Length(steer) < 0.0001f) return { 0,0 };
+    steer = Normalize(steer);
+    return Scale(steer, strength);
+}
+
+// Query API. Each returns the total number of matches; at most `capacity` handles are written to out.
+uint32_t QueryAgentsInRect(const NeighborGrid& g, const std::vector<Agent>& agents, Vector2 min, Vector2 max, uint32_t* out, uint32_t capacity) {
+    uint32_t found = 0;
+    Vector2 center = Scale(Add(min, max), 0.5f), half = Scale(Sub(max, min), 0.5f);
+    ForEachGridNeighbor(g, min, max, [&](uint32_t j, bool wrapped) {
+        if (j >= agents.size()) return;
+        Vector2 p = agents[j].pos;
+        if (wrapped) {
+            Vector2 d = MinImage(Sub(p, center), g.wrap);
+            if (fabsf(d.x) > half.x || fabsf(d.y) > half.y) return;
+        }
+        else if (p.x < min.x || p.x > max.x || p.y < min.y || p.y > max.y) return;
+        if (found < capacity) out[found] = j;
+        found++;
+    });
+    return found;
+}
+
+uint32_t QueryAgentsInRadius(const NeighborGrid& g, const std::vector<Agent>& agents, Vector2 center, float radius, uint32_t* out, uint32_t capacity) {
+    uint32_t found = 0;
+    float r2 = radius * radius;
+    Vector2 r = { radius, radius };
+    ForEachGridNeighbor(g, Sub(center, r), Add(center, r), [&](uint32_t j, bool wrapped) {
+        if (j >= agents.size()) return;
+        Vector2 d = Sub(agents[j].pos, center);
+        if (wrapped) d = MinImage(d, g.wrap);
+        if (d.x * d.x + d.y * d.y > r2) return;
+        if (found < capacity) out[found] = j;
+        found++;
+    });
+    return found;
+}
+
+// Nearest agent within maxRadius of p, or AGENT_NONE; searches rings of cells outward until none can be closer.
+// On a periodic grid the rings continue across the edges and distances are taken to the nearest image.
+uint32_t QueryNearestAgent(const NeighborGrid& g, const std::vector<Agent>& agents, Vector2 p, float maxRadius) {
+    uint32_t best = AGENT_NONE;
+    float bestD2 = maxRadius * maxRadius;
+    if (g.cols == 0) return best;
+    // agents that jumped since the build are few, test them up front; their stale cell entries are harmless here
+    for (size_t k = 1; k < g.jumped.size(); k += 2) {
+        uint32_t j = g.jumped[k];
+        if (j >= agents.size()) continue;
+        Vector2 d = MinImage(Sub(agents[j].pos, p), g.wrap);
+        float d2 = d.x * d.x + d.y * d.y;
+        if (d2 <= bestD2) { bestD2 = d2; best = j; }
+    }
+    const bool wrap = g.wrap.enabled;
+    int cx = GridCoord(p.x, g.origin.x, g.invCell, g.cols), cy = GridCoord(p.y, g.origin.y, g.invCell, g.rows);
+    // on a periodic grid every cell is within half the grid of p's cell
+    int maxRing = wrap ? std::max(g.cols, g.rows) / 2 : std::max(g.cols, g.rows);
+    int slackCells = (int)ceilf(g.slack * g.invCell);
+    for (int ring = 0; ring <= maxRing; ++ring) {
+        // everything in this ring is at least (ring - 1 - slackCells) cells away
+        float ringDist = (float)(ring - 1 - slackCells) * g.cellSize;
+        if (ringDist > 0 && ringDist * ringDist > bestD2) break;
+        for (int y = cy - ring; y <= cy + ring; ++y) {
+            int wy = wrap ? ((y % g.rows) + g.rows) % g.rows : y;
+            if (wy < 0 || wy >= g.rows) continue;
+            bool edgeRow = (y == cy - ring || y == cy + ring);
+            for (int x = cx - ring; x <= cx + ring; x += (edgeRow || ring == 0) ? 1 : 2 * ring) {
+                int wx = wrap ? ((x % g.cols) + g.cols) % g.cols : x;
+                if (wx < 0 || wx >= g.cols) continue;
+                size_t c = (size_t)wy * g.cols + wx;
+                for (uint32_t k = g.cellStart[c]; k < g.cellStart[c + 1]; ++k) {
+                    uint32_t j = g.indices[k];
+                    if (j >= agents.size()) continue;
+                    Vector2 d = MinImage(Sub(agents[j].pos, p), g.wrap);
+                    float d2 = d.x * d.x + d.y * d.y;
+                    if (d2 <= bestD2) { bestD2 = d2; best = j; }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+// n radius queries in one call. Results are packed back to back in out; query q owns out[offsets[q], offsets[q+1]).
+// Returns false if out was too small (offsets still hold the true counts so the caller can resize and retry).
+bool QueryAgentsInRadiusBatch(const NeighborGrid& g, const std::vector<Agent>& agents, const Vector2* centers, const float* radii, size_t n,
+    uint32_t* out, uint32_t capacity, uint32_t* offsets) {
+    uint32_t used = 0;
+    bool fits = true;
+    offsets[0] = 0;
+    for (size_t q = 0; q < n; ++q) {
+        uint32_t room = used < capacity ? capacity - used : 0;
+        uint32_t found = QueryAgentsInRadius(g, agents, centers[q], radii[q], out + std::min(used, capacity), room);
+        if (found > room) fits = false;
+        used += fits ? found : 0;
+        offsets[q + 1] = offsets[q] + found;
+    }
+    return fits;
+}
+
+// ---------- Entity-component store (experiment) ----------
+// A small archetype ECS, tried out on the ambient wanderers below only. The crowd itself stays in the Agent
+// vector and StepAgents, which snapshots, replays, domain runs, the state feed and the trajectory export are
+// all built on. Entities with the same component set share an archetype, which keeps them in fixed-size chunks
+// with one packed array per component (SoA). Systems name the components they need and only visit chunks whose
+// archetype has all of them, so an entity without a behavior's components costs that behavior nothing.
+// An entity gets its whole component set when it is created; there is no add/remove or destroy yet.
+static const size_t ECS_CHUNK_BYTES = 16 * 1024;
+static const uint32_t ECS_MAX_COMPONENTS = 64;
+typedef uint64_t EcsMask;
+
+struct EcsEntity {
+    uint32_t index;
+};
+
+struct EcsComponentInfo {
+    size_t size;
+    size_t align;
+};
+
+static std::vector<EcsComponentInfo>& EcsComponentTable() {
+    static std::vector<EcsComponentInfo> table;
+    return table;
+}
+
+// Ids are handed out on first use, so the same type has the same id in every world
+template <typename T>
+uint32_t EcsComponentId() {
+    static_assert(std::is_trivially_copyable<T>::value, "ECS components are stored as raw bytes");
+    static_assert(alignof(T) <= 16, "chunk columns are only 16-byte aligned");
+    static const uint32_t id = [] {
+        static std::mutex registering;
+        std::lock_guard<std::mutex> lock(registering);
+        std::vector<EcsComponentInfo>& table = EcsComponentTable();
+        if (table.size() >= ECS_MAX_COMPONENTS) { fprintf(stderr, "ECS: more than %u component types\n", ECS_MAX_COMPONENTS); abort(); }
+        table.push_back({ sizeof(T), alignof(T) });
+        return (uint32_t)table.size() - 1;
+    }();
+    return id;
+}
+
+template <typename... Ts>
+EcsMask EcsMaskOf() {
+    EcsMask m = 0;
+    int expand[] = { 0, (m |= (EcsMask)1 << EcsComponentId<Ts>(), 0)... };
+    (void)expand;
+    return m;
+}
+
+struct EcsChunk {
+    std::unique_ptr<unsigned char[]> data; // EcsEntity ids[capacity], then one column per component
+    uint32_t count = 0;
+};
+
+struct EcsArchetype {
+    EcsMask mask = 0;
+    uint32_t capacity = 0;                 // entities per chunk
+    size_t chunkBytes = 0;
+    size_t offsets[ECS_MAX_COMPONENTS];    // column offset inside a chunk, by component id
+    std::vector<uint32_t> components;
+    std::vector<EcsChunk> chunks;          // every chunk but the last is full
+};
+
+struct EcsRecord {
+    uint32_t archetype = 0;
+    uint32_t chunk = 0;
+    uint32_t row = 0;
+};
+
+struct EcsWorld {
+    std::vector<EcsArchetype> archetypes;
+    std::vector<EcsRecord> records;        // by entity index
+    std::vector<std::pair<EcsArchetype*, EcsChunk*>> eachChunks; // EcsEachParallel's work list, kept between calls
+};
+
+static uint32_t EcsArchetypeFor(EcsWorld& w, EcsMask mask) {
+    for (size_t i = 0; i < w.archetypes.size(); ++i)
+        if (w.archetypes[i].mask == mask) return (uint32_t)i;
+    EcsArchetype a;
+    a.mask = mask;
+    const std::vector<EcsComponentInfo>& table = EcsComponentTable();
+    size_t perEntity = sizeof(EcsEntity);
+    for (uint32_t id = 0; id < ECS_MAX_COMPONENTS; ++id) {
+        if (!(mask >> id & 1)) continue;
+        a.components.push_back(id);
+        perEntity += table[id].size;
+    }
+    size_t padding = 16 * (a.components.size() + 1);
+    a.capacity = (uint32_t)std::max<size_t>(1, (ECS_CHUNK_BYTES - padding) / perEntity);
+    size_t offset = a.capacity * sizeof(EcsEntity);
+    for (uint32_t id : a.components) {
+        offset = (offset + 15) & ~(size_t)15;
+        a.offsets[id] = offset;
+        offset += a.capacity * table[id].size;
+    }
+    a.chunkBytes = offset;
+    w.archetypes.push_back(std::move(a));
+    return (uint32_t)w.archetypes.size() - 1;
+}
+
+static EcsEntity* EcsChunkIds(EcsChunk& c) { return (EcsEntity*)c.data.get(); }
+
+// New entity with the components in `mask`, all zeroed
+EcsEntity EcsCreate(EcsWorld& w, EcsMask mask) {
+    uint32_t archetype = EcsArchetypeFor(w, mask);
+    EcsArchetype& a = w.archetypes[archetype];
+    if (a.chunks.empty() || a.chunks.back().count == a.capacity) {
+        a.chunks.emplace_back();
+        a.chunks.back().data.reset(new unsigned char[a.chunkBytes]);
+    }
+    EcsChunk& c = a.chunks.back();
+    EcsEntity e = { (uint32_t)w.records.size() };
+    EcsRecord r;
+    r.archetype = archetype;
+    r.chunk = (uint32_t)a.chunks.size() - 1;
+    r.row = c.count++;
+    w.records.push_back(r);
+    EcsChunkIds(c)[r.row] = e;
+    for (uint32_t id : a.components) memset(c.data.get() + a.offsets[id] + (size_t)r.row * EcsComponentTable()[id].size, 0, EcsComponentTable()[id].size);
+    return e;
+}
+
+// Sets a component e was created with; returns false if it has no T
+template <typename T>
+bool EcsSet(EcsWorld& w, EcsEntity e, const T& value) {
+    if (e.index >= w.records.size()) return false;
+    const EcsRecord& r = w.records[e.index];
+    EcsArchetype& a = w.archetypes[r.archetype];
+    uint32_t id = EcsComponentId<T>();
+    if (!(a.mask >> id & 1)) return false;
+    memcpy(a.chunks[r.chunk].data.get() + a.offsets[id] + (size_t)r.row * sizeof(T), &value, sizeof(T));
+    return true;
+}
+
+// fn(count, ids, T0* columnT0, T1* columnT1, ...) once per chunk that has all of Ts
+template <typename... Ts, typename Fn>
+void EcsEach(EcsWorld& w, const Fn& fn) {
+    EcsMask need = EcsMaskOf<Ts...>();
+    for (EcsArchetype& a : w.archetypes) {
+        if ((a.mask & need) != need) continue;
+        for (EcsChunk& c : a.chunks)
+            fn((size_t)c.count, (const EcsEntity*)EcsChunkIds(c), (Ts*)(c.data.get() + a.offsets[EcsComponentId<Ts>()])...);
+    }
+}
+
+// EcsEach with the matching chunks spread over the worker pool; fn must only touch its own chunk's rows
+template <typename... Ts, typename Fn>
+void EcsEachParallel(EcsWorld& w, const Fn& fn) {
+    EcsMask need = EcsMaskOf<Ts...>();
+    std::vector<std::pair<EcsArchetype*, EcsChunk*>>& chunks = w.eachChunks; // fn must not start another EcsEachParallel on w
+    chunks.clear();
+    for (EcsArchetype& a : w.archetypes) {
+        if ((a.mask & need) != need) continue;
+        for (EcsChunk& c : a.chunks) chunks.push_back({ &a, &c });
+    }
+    ParallelFor(chunks.size(), [&](size_t b, size_t e, unsigned) {
+        for (size_t i = b; i < e; ++i) {
+            EcsArchetype& a = *chunks[i].first;
+            EcsChunk& c = *chunks[i].second;
+            fn((size_t)c.count, (const EcsEntity*)EcsChunkIds(c), (Ts*)(c.data.get() + a.offsets[EcsComponentId<Ts>()])...);
+        }
+    }, 4);
+}
+
+// ---------- ECS wanderers ----------
+// Ambient agents on the experimental ECS, drawn over the crowd and steering around it; the crowd never reads
+// them back. They are not part of snapshots, replays or domain runs. Every wanderer has Position/Velocity/
+// Limits/Steer; WanderState, PathCursor and KeepClear are optional, and each behavior is one system over the
+// chunks that carry its components.
+struct CPosition { Vector2 v; };
+struct CVelocity { Vector2 v; };
+struct CLimits { float maxSpeed, maxForce; };
+struct CSteer { Vector2 v; };           // summed by the behavior systems, consumed by EcsIntegrate
+struct CWanderState { float angle; };
+struct CPathCursor { int index; };
+struct CKeepClear { float radius, strength; }; // separation from the main crowd
+struct CTint { Color color; };
+
+static const uint32_t ECS_AGENT_ID_BASE = 0x80000000u; // RNG ids, clear of the Agent vector's indices
+
+void SpawnEcsWanderers(EcsWorld& w, int count, Vector2 center, uint64_t seed, uint64_t step) {
+    for (int i = 0; i < count; ++i) {
+        uint32_t index = (uint32_t)w.records.size(); // the id EcsCreate hands out next
+        Random4 r = AgentRandom(seed, ECS_AGENT_ID_BASE + index, step, 1);
+        // a third also follow the path, half keep clear of the crowd; the rest only wander
+        bool follow = r.v[3] % 3 == 0, keepClear = (r.v[3] >> 8) & 1;
+        EcsMask mask = EcsMaskOf<CPosition, CVelocity, CLimits, CSteer, CWanderState, CTint>();
+        if (follow) mask |= EcsMaskOf<CPathCursor>();
+        if (keepClear) mask |= EcsMaskOf<CKeepClear>();
+        EcsEntity e = EcsCreate(w, mask);
+        float angle = RandomUnit(r.v[0]) * 2.0f * PI, dist = RandomUnit(r.v[1]) * 60.0f;
+        EcsSet(w, e, CPosition{ { center.x + cosf(angle) * dist, center.y + sinf(angle) * dist } });
+        EcsSet(w, e, CVelocity{ { cosf(angle), sinf(angle) } });
+        EcsSet(w, e, CLimits{ 1.6f + RandomUnit(r.v[2]), 0.12f });
+        EcsSet(w, e, CWanderState{ angle });
+        if (keepClear) EcsSet(w, e, CKeepClear{ 36.0f, 1.5f });
+        EcsSet(w, e, CTint{ follow ? DARKGREEN : keepClear ? PURPLE : GRAY });
+    }
+}
+
+void StepEcsWanderers(EcsWorld& w, const std::vector<Vector2>& path, const std::vector<Agent>& crowd, const NeighborGrid& grid,
+    float waypointRadius, float worldW, float worldH, uint64_t seed, uint64_t step) {
+    EcsEachParallel<CPosition, CVelocity, CLimits, CWanderState, CSteer>(w, [&](size_t n, const EcsEntity* ids,
+        CPosition* p, CVelocity* v, CLimits* l, CWanderState* ws, CSteer* s) {
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t random = AgentRandom(seed, ECS_AGENT_ID_BASE + ids[i].index, step).v[0];
+            Vector2 desired = Wander(p[i].v, v[i].v, l[i].maxSpeed, ws[i].angle, random);
+            s[i].v = Add(s[i].v, Scale(Sub(desired, v[i].v), 0.6f));
+        }
+    });
+    EcsEachParallel<CPosition, CVelocity, CLimits, CPathCursor, CSteer>(w, [&](size_t n, const EcsEntity*,
+        CPosition* p, CVelocity* v, CLimits* l, CPathCursor* pc, CSteer* s) {
+        for (size_t i = 0; i < n; ++i) {
+            Agent probe = {};
+            probe.pos = p[i].v;
+            probe.maxSpeed = l[i].maxSpeed;
+            Vector2 desired = PathFollowing(probe, path, pc[i].index, waypointRadius);
+            s[i].v = Add(s[i].v, Sub(desired, v[i].v));
+        }
+    });
+    EcsEachParallel<CPosition, CKeepClear, CSteer>(w, [&](size_t n, const EcsEntity*, CPosition* p, CKeepClear* k, CSteer* s) {
+        uint32_t hits[32];
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t found = std::min(QueryAgentsInRadius(grid, crowd, p[i].v, k[i].radius, hits, 32), 32u);
+            Vector2 away = { 0,0 };
+            for (uint32_t j = 0; j < found; ++j) {
+                Vector2 diff = MinImage(Sub(p[i].v, crowd[hits[j]].pos), grid.wrap);
+                float d = Length(diff);
+                if (d > 0) away = Add(away, Scale(Normalize(diff), (k[i].radius - d) / k[i].radius));
+            }
+            if (Length(away) > 0.0001f) s[i].v = Add(s[i].v, Scale(Normalize(away), k[i].strength));
+        }
+    });
+    EcsEachParallel<CPosition, CVelocity, CLimits, CSteer>(w, [&](size_t n, const EcsEntity*, CPosition* p, CVelocity* v, CLimits* l, CSteer* s) {
+        for (size_t i = 0; i < n; ++i) {
+            v[i].v = Limit(Add(v[i].v, Limit(s[i].v, l[i].maxForce)), l[i].maxSpeed);
+            p[i].v = Add(p[i].v, v[i].v);
+            s[i].v = { 0,0 };
+            WrapWorldPosition(p[i].v, worldW, worldH, grid.wrap);
+        }
+    });
+}
+
+// ---------- Behavior counters ----------
+// How often each behavior actually fires, to show where culling would pay off. A step counts into its own
+// BehaviorCounters (a local in StepAgents, a stack local per chunk in StepContinuum, added to the worker's slot
+// once the chunk is done) and adds them to the caller's total once at the end, so the hot loops share nothing.
+enum PriorityTier { TIER_DANGER, TIER_SAFETY, TIER_NAVIGATION, TIER_NONE, TIER_COUNT };
+
+struct BehaviorCounters {
+    uint64_t agents = 0; // whose steering was evaluated; time-sliced agents reusing last step's are not counted
+    uint64_t sepTested = 0, sepAccepted = 0;         // separation candidate pairs / pairs inside the radius
+    uint64_t predictTested = 0, predictActive = 0;   // PredictiveAvoidance calls / non-zero results
+    uint64_t pathActive = 0, sepActive = 0, predictAgents = 0; // agents with a non-zero force of that kind
+    uint64_t obsEvaluated = 0, obsActive = 0;        // ObstacleAvoidance calls / non-zero results
+    uint64_t wallActive = 0;
+    uint64_t tier[TIER_COUNT] = {};                  // PrioritySteering winners, priority blending only
+};
+static_assert(sizeof(BehaviorCounters) % sizeof(uint64_t) == 0, "BehaviorCounters is summed as uint64_t words");
+
+void AddBehaviorCounters(BehaviorCounters& into, const BehaviorCounters& c) {
+    uint64_t* dst = (uint64_t*)&into;
+    const uint64_t* src = (const uint64_t*)&c;
+    for (size_t k = 0; k < sizeof(BehaviorCounters) / sizeof(uint64_t); ++k) dst[k] += src[k];
+}
+
+static bool NonZero(Vector2 v) { return v.x != 0 || v.y != 0; }
+
+// ---------- Grid cell tuning ----------
+// The best cell for StepAgents' grid depends on the separation radius, the predictive range and how crowded
+// the cells get, so the step's cell (max(separationRadius, predictRange)) is multiplied by a scale found online.
+// Every GRID_TUNE_WINDOW steps the tuner compares the neighbour stage (grid build plus the agent loop, whose
+// other work doesn't depend on the cell) against the previous window: it alternates a baseline window at the
+// current scale with a probe one rung up or down a 2^(1/4) ladder and keeps the probe only if it is clearly
+// faster. Once both directions lose it holds for a few windows, then probes again as the crowd changes.
+// Scale changes depend on timing, so they travel in FrameInput and the input log; a replay applies the recorded
+// scales instead of measuring.
+static const int GRID_TUNE_WINDOW = 240;
+static const int GRID_TUNE_MIN_LEVEL = -4, GRID_TUNE_MAX_LEVEL = 4; // scale = 2^(level / 4), 0.5 .. 2
+static const int GRID_TUNE_HOLD_WINDOWS = 4;
+static const double GRID_TUNE_MIN_GAIN = 0.03; // a probe has to be this much faster to be kept
+
+struct GridTuner {
+    float scale = 1.0f; // in effect; set from FrameInput::gridScale
+    int level = 0;      // ladder rung of the baseline
+    int probe = 0;      // rung being measured, == level during baseline windows
+    int direction = 1;
+    int failures = 0;   // probes lost against the current baseline
+    int hold = 0;       // baseline windows left before probing again
+    double baselineMs = 0;
+    size_t agentCount = 0;
+    // current window
+    int steps = 0;
+    double ms = 0;
+    uint64_t queries = 0, candidates = 0;
+    // last finished window, for the HUD
+    double lastMs = 0;
+    float lastCandidatesPerQuery = 0;
+};
+
+static float GridTuneScale(int level) { return powf(2.0f, level / 4.0f); }
+
+static void ResetGridTuneWindow(GridTuner& t) {
+    t.steps = 0;
+    t.ms = 0;
+    t.queries = t.candidates = 0;
+}
+
+// Called by StepAgents with the cost of one neighbour stage at t.scale
+void GridTunerSample(GridTuner& t, size_t agentCount, double ms, uint64_t queries, uint64_t candidates) {
+    if (agentCount != t.agentCount) {
+        // a new population doesn't compare with the old baseline: measure it again before probing
+        t.agentCount = agentCount;
+        t.probe = t.level;
+        t.failures = 0;
+        t.hold = 0;
+        ResetGridTuneWindow(t);
+        return;
+    }
+    if (GridTuneScale(t.probe) != t.scale) return; // change not applied yet
+    t.steps++;
+    t.ms += ms;
+    t.queries += queries;
+    t.candidates += candidates;
+}
+
+static void StartGridTuneProbe(GridTuner& t) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int next = t.level + t.direction;
+        if (next >= GRID_TUNE_MIN_LEVEL && next <= GRID_TUNE_MAX_LEVEL) { t.probe = next; return; }
+        t.direction = -t.direction;
+    }
+}
+
+// Closes the window once it is full and returns the scale the next step should use, or 0 to keep the current one
+float GridTunerPropose(GridTuner& t) {
+    if (t.steps >= GRID_TUNE_WINDOW) {
+        double mean = t.ms / t.steps;
+        t.lastMs = mean;
+        t.lastCandidatesPerQuery = t.queries ? (float)((double)t.candidates / (double)t.queries) : 0.0f;
+        if (t.probe == t.level) {
+            t.baselineMs = mean;
+            if (t.hold > 0) t.hold--;
+            else StartGridTuneProbe(t);
+        }
+        else if (mean < t.baselineMs * (1.0 - GRID_TUNE_MIN_GAIN)) {
+            // keep going the same way from the new rung
+            t.level = t.probe;
+            t.baselineMs = mean;
+            t.failures = 0;
+            StartGridTuneProbe(t);
+        }
+        else {
+            t.probe = t.level;
+            t.direction = -t.direction;
+            if (++t.failures >= 2) {
+                t.failures = 0;
+                t.hold = GRID_TUNE_HOLD_WINDOWS;
+            }
+        }
+        ResetGridTuneWindow(t);
+    }
+    float want = GridTuneScale(t.probe);
+    return want != t.scale ? want : 0.0f;
+}
+
+// ---------- Load shedding ----------
+// Keeps a spike in agent count from stalling input and rendering with it. Opt-in with --budget <ms>: the
+// controller follows the step time against that budget. After LOAD_ESCALATE_STEPS steps over budget it sheds one
+// more level; after LOAD_RECOVER_STEPS steps under half the budget it restores one. Levels are cumulative:
+//   1  predictive avoidance runs every other step per agent, the rest reuse their last result
+//   2  debug drawing is skipped
+//   3  steering is time-sliced: half of the agents recompute per step, the others keep their last steering
+//      (agents due for obstacle avoidance always recompute)
+//   4  agents further than LOAD_LOD_RADIUS from the focus (the mouse, or the world centre without a window)
+//      drop separation and predictive avoidance
+// As with the grid tuner, level changes depend on timing, so they travel in FrameInput and the input log.
+enum LoadLevel { LOAD_FULL, LOAD_PREDICT_HALF, LOAD_NO_DEBUG_DRAW, LOAD_TIME_SLICED, LOAD_DISTANT_LOD, LOAD_LEVEL_COUNT };
+static const char* const LOAD_LEVEL_NAMES[LOAD_LEVEL_COUNT] = {
+    "full", "predictive every other step", "no debug drawing", "time-sliced steering", "distant agents simplified"
+};
+static const int LOAD_ESCALATE_STEPS = 10;
+static const int LOAD_RECOVER_STEPS = 180;
+static const float LOAD_LOD_RADIUS = 450.0f;
+
+struct LoadShedder {
+    float budgetMs = 0;     // step time to stay under, e.g. 12 ms of a 60 Hz frame; 0 disables shedding
+    int level = LOAD_FULL;  // in effect; set from FrameInput::loadLevel
+    float avgMs = 0;
+    int over = 0, under = 0; // consecutive steps above budget / below half of it
+    Vector2 focus = { 0,0 };
+    std::vector<Vector2> predictCache, steerCache; // last results for agents that skip a step; cleared when stale
+};
+
+void LoadShedderSample(LoadShedder& ls, float stepMs) {
+    ls.avgMs += (stepMs - ls.avgMs) * 0.2f;
+    ls.over = ls.avgMs > ls.budgetMs ? ls.over + 1 : 0;
+    ls.under = ls.avgMs < 0.5f * ls.budgetMs ? ls.under + 1 : 0;
+}
+
+// The level the next step should run at, or -1 to keep the current one
+int LoadShedderPropose(LoadShedder& ls) {
+    int want = ls.level;
+    if (ls.budgetMs <= 0) want = LOAD_FULL;
+    else if (ls.over >= LOAD_ESCALATE_STEPS && ls.level + 1 < LOAD_LEVEL_COUNT) want = ls.level + 1;
+    else if (ls.under >= LOAD_RECOVER_STEPS && ls.level > LOAD_FULL) want = ls.level - 1;
+    if (want == ls.level) return -1;
+    ls.over = ls.under = 0; // let the new level settle before judging it
+    return want;
+}
+
+// Returns true when the caches had to be (re)filled, i.e. they hold nothing a skipping agent could reuse
+static bool SizeLoadCaches(LoadShedder& ls, size_t count) {
+    if (ls.predictCache.size() == count && ls.steerCache.size() == count) return false;
+    ls.predictCache.assign(count, { 0,0 });
+    ls.steerCache.assign(count, { 0,0 });
+    return true;
+}
+
+// ---------- Team pursuit ----------
+// Predator/prey crowds. With SteeringSettings::enablePursuit, odd agents (maroon) hunt and even agents (sky blue)
+// flee. Opponents come from a box query on the step's neighbour grid, bounded by the sense radius. A predator
+// takes the nearest prey; a prey takes the predator that will be closest to it after PURSUIT_THREAT_LOOKAHEAD
+// steps. Choices are cached and re-queried every PURSUIT_REFRESH_STEPS steps, staggered by agent index. Between
+// refreshes a target is only dropped when it leaves the sense radius, so each step queries 1/8 of the agents and
+// selection cost grows with local density, not with predators x prey.
+enum PursuitTeam : uint8_t { TEAM_PREY, TEAM_PREDATOR };
+static const uint32_t PURSUIT_REFRESH_STEPS = 8;
+static const float PURSUIT_THREAT_LOOKAHEAD = 20.0f;
+
+struct PursuitTeams {
+    std::vector<uint8_t> team;    // PursuitTeam per agent
+    std::vector<uint32_t> target; // cached opponent, AGENT_NONE while nobody is in range
+    uint64_t queries = 0;         // target selections in the last step
+};
+
+void SizePursuitTeams(PursuitTeams& pt, size_t count) {
+    size_t old = pt.team.size();
+    pt.team.resize(count);
+    pt.target.resize(count, AGENT_NONE);
+    for (size_t i = old; i < count; ++i) pt.team[i] = (i % 2) ? TEAM_PREDATOR : TEAM_PREY;
+}
+
+// Best opponent of agents[i] within radius among agents[0, count), or AGENT_NONE
+uint32_t ChoosePursuitTarget(const PursuitTeams& pt, const std::vector<Agent>& agents, size_t count, const NeighborGrid& grid, size_t i, float radius) {
+    const Agent& a = agents[i];
+    bool predator = pt.team[i] == TEAM_PREDATOR;
+    uint32_t best = AGENT_NONE;
+    float bestScore = 1e30f;
+    Vector2 r = { radius, radius };
+    ForEachGridNeighbor(grid, Sub(a.pos, r), Add(a.pos, r), [&](uint32_t j, bool) {
+        if (j >= count || pt.team[j] == pt.team[i]) return;
+        Vector2 d = MinImage(Sub(agents[j].pos, a.pos), grid.wrap);
+        float d2 = d.x * d.x + d.y * d.y;
+        if (d2 > radius * radius) return;
+        float score = d2;
+        if (!predator) {
+            Vector2 ahead = Add(d, Scale(agents[j].vel, PURSUIT_THREAT_LOOKAHEAD));
+            score = ahead.x * ahead.x + ahead.y * ahead.y;
+        }
+        if (score < bestScore) { bestScore = score; best = j; }
+    });
+    return best;
+}
+
+// ---------- Simulation events ----------
+// Discrete happenings inside a step, for consumers outside the steering code. Step functions append SimEvents
+// to the buffer of the worker that runs the agent (no locks, and nothing is allocated once the buffers have
+// grown). MergeEvents then counting-sorts them by type into one contiguous array. ParallelFor hands workers
+// ascending index ranges, so each type's events come out in agent order, whatever the thread count.
+enum SimEventType : uint8_t { EVENT_WAYPOINT_REACHED, EVENT_NEAR_COLLISION, EVENT_WALL_HIT, EVENT_TYPE_COUNT };
+enum WallSide : uint32_t { WALL_LEFT, WALL_RIGHT, WALL_TOP, WALL_BOTTOM };
+
+struct SimEvent {
+    uint8_t type;   // SimEventType
+    uint8_t pad[3];
+    uint32_t agent;
+    uint32_t other; // waypoint index reached / the other agent (agent < other) / WallSide
+    float value;    // 0 / centre distance / speed at the hit
+};
+static_assert(sizeof(SimEvent) == 16, "SimEvent is a 16 byte wire record");
+
+struct EventRange {
+    const SimEvent* first;
+    const SimEvent* last;
+    const SimEvent* begin() const { return first; }
+    const SimEvent* end() const { return last; }
+    size_t size() const { return (size_t)(last - first); }
+};
+
+struct EventStream {
+    uint64_t step = 0;
+    std::vector<std::vector<SimEvent>> pending; // per worker, filled during the step
+    std::vector<SimEvent> events;               // merged: grouped by type, each group in agent order
+    uint32_t typeStart[EVENT_TYPE_COUNT + 1] = {};
+    uint64_t total[EVENT_TYPE_COUNT] = {};      // since start
+};
+
+void BeginEvents(EventStream& es, uint64_t step) {
+    es.step = step;
+    es.pending.resize(WorkerCount());
+    for (std::vector<SimEvent>& b : es.pending) b.clear();
+}
+
+static void EmitEvent(EventStream* es, unsigned worker, SimEventType type, uint32_t agent, uint32_t other, float value) {
+    if (!es) return;
+    SimEvent e = { (uint8_t)type, { 0,0,0 }, agent, other, value };
+    es->pending[worker].push_back(e);
+}
+
+void MergeEvents(EventStream& es) {
+    uint32_t count[EVENT_TYPE_COUNT] = {};
+    for (const std::vector<SimEvent>& b : es.pending)
+        for (const SimEvent& e : b) count[e.type]++;
+    uint32_t at[EVENT_TYPE_COUNT];
+    es.typeStart[0] = 0;
+    for (int t = 0; t < EVENT_TYPE_COUNT; ++t) {
+        at[t] = es.typeStart[t];
+        es.typeStart[t + 1] = es.typeStart[t] + count[t];
+        es.total[t] += count[t];
+    }
+    es.events.resize(es.typeStart[EVENT_TYPE_COUNT]);
+    for (const std::vector<SimEvent>& b : es.pending)
+        for (const SimEvent& e : b) es.events[at[e.type]++] = e;
+}
+
+// The last merged step's events of one type
+EventRange EventsOfType(const EventStream& es, SimEventType type) {
+    const SimEvent* base = es.events.data();
+    EventRange r = { base + es.typeStart[type], base + es.typeStart[type + 1] };
+    return r;
+}
+
+// Open world only: the first step an agent is past the screen edge counts as hitting that wall
+static void EmitWallHit(EventStream* es, unsigned worker, uint32_t agent, Vector2 before, Vector2 after, float speed, float worldW, float worldH) {
+    if (!es) return;
+    if (after.x < 0 && before.x >= 0) EmitEvent(es, worker, EVENT_WALL_HIT, agent, WALL_LEFT, speed);
+    else if (after.x > worldW && before.x <= worldW) EmitEvent(es, worker, EVENT_WALL_HIT, agent, WALL_RIGHT, speed);
+    else if (after.y < 0 && before.y >= 0) EmitEvent(es, worker, EVENT_WALL_HIT, agent, WALL_TOP, speed);
+    else if (after.y > worldH && before.y <= worldH) EmitEvent(es, worker, EVENT_WALL_HIT, agent, WALL_BOTTOM, speed);
+}
+
+// Pairs (agent < other) of the first `count` agents whose centres are closer than two agent radii. Runs as a pass
+// of its own after the step, on the grid the step left behind, so the events don't depend on which behaviors
+// ran, on load shedding or on the step mode.
+void EmitNearCollisions(EventStream* es, const std::vector<Agent>& agents, size_t count, const NeighborGrid& grid, float agentRadius) {
+    if (!es || !(agentRadius > 0)) return;
+    float limit = 2.0f * agentRadius;
+    Vector2 box = { limit, limit };
+    ParallelFor(count, [&](size_t b, size_t e, unsigned w) {
+        for (size_t i = b; i < e; ++i) {
+            Vector2 p = agents[i].pos;
+            ForEachGridNeighbor(grid, Sub(p, box), Add(p, box), [&](uint32_t j, bool wrapped) {
+                if (j <= i || j >= count) return;
+                Vector2 d = Sub(agents[j].pos, p);
+                if (wrapped) d = MinImage(d, grid.wrap);
+                float gap = Length(d);
+                if (gap < limit) EmitEvent(es, w, EVENT_NEAR_COLLISION, (uint32_t)i, j, gap);
+            });
+        }
+    }, 4096);
+}
+
+// ---------- Multi-agent step (Task2) ----------
+struct SteeringSettings {
+    bool enablePathFollowing = true;
+    bool enableSeparation = true;
+    bool enablePredictiveAvoid = true;
+    bool enableObstacleAvoid = true;
+    bool enableWallAvoid = true;
+    bool usePriority = true; // Task3: use priority blending vs weighted blending
+    bool farFieldSeparation = false; // approximate distant separation neighbours by cluster (Barnes-Hut)
+    bool continuumMode = false; // steer by density/potential fields instead of neighbour forces (StepContinuum)
+    bool enableContacts = false; // push overlapping agents apart after integration (SolveContacts)
+    bool toroidalWorld = false; // periodic edges: neighbours and separations wrap, no wall avoidance
+    bool enablePursuit = false; // predators chase and prey evade their nearest opponents (see Team pursuit)
+
+    float separationRadius = 48.0f;
+    float separationStrength = 0.9f;
+    float predictiveLookAhead = 0.9f;
+    float predictiveStrength = 0.9f;
+    float obstacleLookAhead = 70.0f;
+    float obstacleStrength = 1.2f;
+    float wallMargin = 40.0f;
+    float wallStrength = 1.6f;
+    float pathWaypointRadius = 22.0f;
+    float farFieldTheta = 0.5f; // cluster size / distance below which a cluster counts as one point, 0 = exact
+    float continuumCellSize = 16.0f;
+    float continuumMaxDensity = 2.5f; // agents per cell at which walking speed bottoms out
+    float agentRadius = 12.0f; // contact disc, half of PredictiveAvoidance's combined radius
+    int contactIterations = 4;
+    float pursuitSenseRadius = 260.0f;
+};
+
+WorldWrap WorldWrapFor(const SteeringSettings& s, float worldW, float worldH) {
+    WorldWrap w;
+    w.enabled = s.toroidalWorld;
+    w.min = { -WORLD_EDGE_MARGIN, -WORLD_EDGE_MARGIN };
+    w.size = { worldW + 2 * WORLD_EDGE_MARGIN, worldH + 2 * WORLD_EDGE_MARGIN };
+    return w;
+}
+
+// Occupancy bitmap for obstacle avoidance: one bit per OBSTACLE_BITMAP_CELL cell of the world, set where any
+// obstacle inflated by ObstacleAvoidance's buffer and the look-ahead (plus a pixel for rounding) overlaps the
+// cell. `ahead` is never further than lookAhead from the agent, so an agent in a clear cell gets zero avoidance
+// and the whole ObstacleAvoidance call can be skipped on one bit test. Positions outside the map (and NaN)
+// count as occupied. Rebuilt only when the obstacles, look-ahead or world size change.
+static const float OBSTACLE_BITMAP_CELL = 32.0f;
+
+struct ObstacleBitmap {
+    Vector2 origin = { 0,0 };
+    float invCell = 1.0f / OBSTACLE_BITMAP_CELL;
+    int cols = 0, rows = 0;
+    std::vector<uint64_t> bits;
+    std::vector<uint8_t> clear; // per agent, filled by MarkObstacleClearAgents
+    uint64_t obstacleHash = 0;
+    float lookAhead = -1;
+    Vector2 worldSize = { -1,-1 };
+};
+
+static uint64_t HashObstacles(const std::vector<Vector2>& centers, const std::vector<float>& radii) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < centers.size(); ++i) {
+        uint32_t bits[3];
+        memcpy(bits, &centers[i], sizeof(Vector2));
+        memcpy(&bits[2], &radii[i], sizeof(float));
+        for (uint32_t b : bits) h = (h ^ b) * 1099511628211ull;
+    }
+    return h;
+}
+
+void UpdateObstacleBitmap(ObstacleBitmap& bm, const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii, float lookAhead,
+    float worldW, float worldH) {
+    uint64_t hash = HashObstacles(obsCenters, obsRadii);
+    if (bm.cols > 0 && bm.obstacleHash == hash && bm.lookAhead == lookAhead && bm.worldSize.x == worldW && bm.worldSize.y == worldH) return;
+    bm.obstacleHash = hash;
+    bm.lookAhead = lookAhead;
+    bm.worldSize = { worldW, worldH };
+    bm.origin = { -WORLD_EDGE_MARGIN, -WORLD_EDGE_MARGIN };
+    bm.cols = (int)ceilf((worldW + 2 * WORLD_EDGE_MARGIN) * bm.invCell) + 1;
+    bm.rows = (int)ceilf((worldH + 2 * WORLD_EDGE_MARGIN) * bm.invCell) + 1;
+    bm.bits.assign(((size_t)bm.cols * bm.rows + 63) / 64, 0);
+    for (size_t o = 0; o < obsCenters.size(); ++o) {
+        Vector2 c = obsCenters[o];
+        float r = obsRadii[o] + 8.0f + lookAhead + 1.0f;
+        int x0 = GridCoord(c.x - r, bm.origin.x, bm.invCell, bm.cols), x1 = GridCoord(c.x + r, bm.origin.x, bm.invCell, bm.cols);
+        int y0 = GridCoord(c.y - r, bm.origin.y, bm.invCell, bm.rows), y1 = GridCoord(c.y + r, bm.origin.y, bm.invCell, bm.rows);
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x) {
+                // closest point of the cell to the centre
+                float cx = std::max(bm.origin.x + x * OBSTACLE_BITMAP_CELL, std::min(c.x, bm.origin.x + (x + 1) * OBSTACLE_BITMAP_CELL));
+                float cy = std::max(bm.origin.y + y * OBSTACLE_BITMAP_CELL, std::min(c.y, bm.origin.y + (y + 1) * OBSTACLE_BITMAP_CELL));
+                if ((cx - c.x) * (cx - c.x) + (cy - c.y) * (cy - c.y) > r * r) continue;
+                size_t cell = (size_t)y * bm.cols + x;
+                bm.bits[cell >> 6] |= 1ull << (cell & 63);
+            }
+    }
+}
+
+static bool ObstacleCellClear(const ObstacleBitmap& bm, int cell) { return !((bm.bits[(size_t)cell >> 6] >> (cell & 63)) & 1); }
+
+// bm.clear[i] = whether agents[i] sits in an empty cell, for i in [b, e); four agents per SSE iteration
+void MarkObstacleClearAgents(ObstacleBitmap& bm, const std::vector<Agent>& agents, size_t b, size_t e) {
+    size_t i = b;
+#if defined(STEER_SSE2)
+    const __m128 ox = _mm_set1_ps(bm.origin.x), oy = _mm_set1_ps(bm.origin.y), inv = _mm_set1_ps(bm.invCell);
+    const __m128 cols = _mm_set1_ps((float)bm.cols), rows = _mm_set1_ps((float)bm.rows), zero = _mm_setzero_ps();
+    for (; i + 4 <= e; i += 4) {
+        const Agent* a = &agents[i];
+        __m128 fx = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(a[0].pos.x, a[1].pos.x, a[2].pos.x, a[3].pos.x), ox), inv);
+        __m128 fy = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(a[0].pos.y, a[1].pos.y, a[2].pos.y, a[3].pos.y), oy), inv);
+        // NaN fails every compare, so it lands outside
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(fx, zero), _mm_cmplt_ps(fx, cols)),
+            _mm_and_ps(_mm_cmpge_ps(fy, zero), _mm_cmplt_ps(fy, rows)));
+        int mask = _mm_movemask_ps(inside);
+        // row * cols + col in float: SSE2 has no 32-bit multiply, and the map is far below 2^24 cells
+        __m128 cellf = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(fy)), cols), _mm_cvtepi32_ps(_mm_cvttps_epi32(fx)));
+        alignas(16) int32_t cell[4];
+        _mm_store_si128((__m128i*)cell, _mm_cvttps_epi32(cellf));
+        for (int k = 0; k < 4; ++k) bm.clear[i + k] = ((mask >> k) & 1) && ObstacleCellClear(bm, cell[k]);
+    }
+#endif
+    for (; i < e; ++i) {
+        float fx = (agents[i].pos.x - bm.origin.x) * bm.invCell, fy = (agents[i].pos.y - bm.origin.y) * bm.invCell;
+        bool inside = fx >= 0 && fx < (float)bm.cols && fy >= 0 && fy < (float)bm.rows;
+        bm.clear[i] = inside && ObstacleCellClear(bm, (int)fy * bm.cols + (int)fx);
+    }
+}
+
+// SpawnAgents with s.clearance applied: the bitmap, built with the clearance as its look-ahead, passes most
+// draws on one bit test; only draws in occupied cells are checked against the obstacles themselves. Draws outside
+// the obstacles' reach pass without either, so the bitmap only spans up to min(world, that reach).
+static const double SPAWN_BITMAP_MAX_CELLS = 16.0 * 1024 * 1024;
+size_t SpawnAgentsClear(Agent* out, size_t firstIndex, const ScenarioSpawn& s, uint64_t seed, const std::vector<Vector2>& path,
+    const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii, float worldW, float worldH) {
+    if (s.clearance < 0 || obsCenters.empty()) return SpawnAgents(out, firstIndex, s, seed, path);
+    Vector2 lo = obsCenters[0], hi = obsCenters[0];
+    for (size_t o = 0; o < obsCenters.size(); ++o) {
+        float r = obsRadii[o] + s.clearance;
+        lo = { std::min(lo.x, obsCenters[o].x - r), std::min(lo.y, obsCenters[o].y - r) };
+        hi = { std::max(hi.x, obsCenters[o].x + r), std::max(hi.y, obsCenters[o].y + r) };
+    }
+    worldW = std::min(worldW, hi.x);
+    worldH = std::min(worldH, hi.y);
+    ObstacleBitmap bm;
+    bool bitmap = worldW > 0 && worldH > 0 && (double)(worldW + 2 * WORLD_EDGE_MARGIN) * (worldH + 2 * WORLD_EDGE_MARGIN)
+        < SPAWN_BITMAP_MAX_CELLS * OBSTACLE_BITMAP_CELL * OBSTACLE_BITMAP_CELL;
+    if (bitmap) UpdateObstacleBitmap(bm, obsCenters, obsRadii, std::max(0.0f, s.clearance - 9.0f), worldW, worldH); // 9 = buffer + rounding
+    return SpawnAgents(out, firstIndex, s, seed, path, [&](Vector2 p) {
+        if (p.x < lo.x || p.x > hi.x || p.y < lo.y || p.y > hi.y) return false;
+        float fx = (p.x - bm.origin.x) * bm.invCell, fy = (p.y - bm.origin.y) * bm.invCell;
+        if (bitmap && fx >= 0 && fx < (float)bm.cols && fy >= 0 && fy < (float)bm.rows && ObstacleCellClear(bm, (int)fy * bm.cols + (int)fx)) return false;
+        for (size_t o = 0; o < obsCenters.size(); ++o)
+            if (Length(Sub(p, obsCenters[o])) < obsRadii[o] + s.clearance) return true;
+        return false;
+    });
+}
+
+// Kinetic schedule for obstacle avoidance. ObstacleAvoidance is zero unless an agent is within lookAhead plus
+// an obstacle's buffered radius, and an agent covers at most maxSpeed (plus whatever the contact solver may push
+// it) per step, so from its distance to the nearest obstacle we know the first step it could need avoidance.
+// Those steps sit in a min-heap; StepAgents evaluates ObstacleAvoidance only for agents whose event is due
+// and reschedules them after they move. Anything that moves agents outside StepAgents (snapshot loads, the
+// continuum step) or changes the obstacles or look-ahead makes the next step schedule everyone afresh.
+struct ObstacleSchedule {
+    typedef std::pair<uint64_t, uint32_t> Event; // step, agent
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> heap;
+    std::vector<uint64_t> next;   // live event per agent; heap entries that disagree are stale
+    std::vector<uint8_t> due;
+    uint64_t lastStep = 0;
+    size_t agentCount = 0;
+    float lookAhead = -1;
+    float extraMotion = -1;
+    uint64_t obstacleHash = 0;
+    bool valid = false;
+    uint32_t evaluated = 0;       // agents that ran ObstacleAvoidance in the last step
+};
+
+void InvalidateObstacleSchedule(ObstacleSchedule& os) { os.valid = false; }
+
+// First step at or after `step` on which `a` could be close enough to an obstacle to need avoidance
+static uint64_t NextObstacleEvent(const Agent& a, uint64_t step, const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii,
+    float lookAhead, float extraMotion) {
+    float gap = 1e30f;
+    for (size_t o = 0; o < obsCenters.size(); ++o)
+        gap = std::min(gap, Length(Sub(a.pos, obsCenters[o])) - (obsRadii[o] + 8.0f) - lookAhead - 1.0f); // 8 = ObstacleAvoidance's buffer, 1 for rounding
+    float v = a.maxSpeed + extraMotion;
+    if (!(gap > 0) || !(v > 0)) return step;
+    return step + (uint64_t)std::min(gap / v, 1e6f);
+}
+
+// Pops the agents due at `step` into os.due, rebuilding the schedule if it went stale
+static void BeginObstacleSchedule(ObstacleSchedule& os, size_t count, uint64_t step, const std::vector<Vector2>& obsCenters,
+    const std::vector<float>& obsRadii, float lookAhead, float extraMotion) {
+    uint64_t hash = HashObstacles(obsCenters, obsRadii);
+    if (!os.valid || os.agentCount != count || os.lookAhead != lookAhead || os.extraMotion != extraMotion || os.obstacleHash != hash
+        || step != os.lastStep + 1) {
+        os.heap = decltype(os.heap)();
+        os.next.assign(count, step);
+        os.due.assign(count, 1);
+        os.agentCount = count;
+        os.lookAhead = lookAhead;
+        os.extraMotion = extraMotion;
+        os.obstacleHash = hash;
+        os.valid = true;
+    }
+    else {
+        std::fill(os.due.begin(), os.due.end(), (uint8_t)0);
+        while (!os.heap.empty() && os.heap.top().first <= step) {
+            ObstacleSchedule::Event e = os.heap.top();
+            os.heap.pop();
+            if (os.next[e.second] == e.first) os.due[e.second] = 1;
+        }
+    }
+    os.lastStep = step;
+    os.evaluated = 0;
+}
+
+static void RescheduleObstacleEvent(ObstacleSchedule& os, uint32_t i, uint64_t when) {
+    os.next[i] = when;
+    os.heap.push({ when, i });
+}
+
+// Advances agents[0, count) by one step. Agents past `count` (ghosts owned by another domain) are seen as
+// neighbours but not moved. Without an obstacle schedule every agent runs ObstacleAvoidance and without an
+// occupancy bitmap none is screened out; without a tuner the grid cell is unscaled. Counters, if given, are added to.
+// A shedder's level trades quality for time (see Load shedding); trajectory export always runs at full quality.
+// Pursuit needs the team table; without one the pursuit toggle does nothing. Events, if given, go to worker 0's
+// buffer; near collisions come from EmitNearCollisions after the step.
+// `farFieldGrid` holds the finer cells and mass pyramid of far-field separation; without it separation is exact.
+// `grid` keeps cells sized for the predictive and pursuit queries either way.
+void StepAgents(std::vector<Agent>& agents, size_t count, NeighborGrid& grid, NeighborGrid* farFieldGrid, ObstacleSchedule* obstacleSchedule, ObstacleBitmap* occupancy,
+    GridTuner* gridTuner, BehaviorCounters* counters, LoadShedder* shedder, PursuitTeams* pursuit, EventStream* events, const std::vector<Vector2>& path,
+    const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii, const SteeringSettings& s, float worldW, float worldH, uint64_t step,
+    TrajectoryExporter* trajectory) {
+    // nobody moves further than vmax this step, and two agents further apart than predictRange can't collide within the look-ahead
+    double neighbourStart = NowSeconds();
+    float vmax = 0;
+    for (const Agent& a : agents) vmax = std::max(vmax, std::max(a.maxSpeed, Length(a.vel)));
+    float predictRange = 24.0f + 2.0f * vmax * s.predictiveLookAhead;
+    WorldWrap wrap = WorldWrapFor(s, worldW, worldH);
+    // the mass pyramid doesn't know about the wrap, so a periodic world separates exactly
+    bool farField = s.farFieldSeparation && !wrap.enabled && farFieldGrid;
+    bool wallAvoid = s.enableWallAvoid && !wrap.enabled;
+    if (s.enableSeparation && farField) {
+        // much finer cells so the pyramid has levels to aggregate inside the separation radius
+        BuildNeighborGrid(*farFieldGrid, agents, s.separationRadius / FAR_FIELD_CELLS_PER_RADIUS, vmax);
+        BuildMassPyramid(*farFieldGrid, agents);
+    }
+    BuildNeighborGrid(grid, agents, std::max(s.separationRadius, predictRange) * (gridTuner ? gridTuner->scale : 1.0f), vmax, wrap);
+    uint64_t queries = 0;
+    BehaviorCounters bc;
+    Vector2 predictBox = { predictRange, predictRange };
+    float contactMotion = s.enableContacts ? s.contactIterations * s.agentRadius : 0.0f;
+    if (obstacleSchedule) BeginObstacleSchedule(*obstacleSchedule, count, step, obsCenters, obsRadii, s.obstacleLookAhead, contactMotion);
+    if (occupancy && s.enableObstacleAvoid) {
+        UpdateObstacleBitmap(*occupancy, obsCenters, obsRadii, s.obstacleLookAhead, worldW, worldH);
+        occupancy->clear.resize(count);
+        MarkObstacleClearAgents(*occupancy, agents, 0, count);
+    }
+    int loadLevel = shedder && !(trajectory && trajectory->file) ? shedder->level : LOAD_FULL;
+    // with fresh caches there is nothing to reuse, so every agent computes this step
+    bool freshCaches = shedder && SizeLoadCaches(*shedder, count);
+    bool predictHalf = loadLevel >= LOAD_PREDICT_HALF && !freshCaches, timeSliced = loadLevel >= LOAD_TIME_SLICED && !freshCaches;
+    bool lod = loadLevel >= LOAD_DISTANT_LOD;
+    bool pursue = pursuit && s.enablePursuit;
+    if (pursue) {
+        SizePursuitTeams(*pursuit, count);
+        pursuit->queries = 0;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        Agent& a = agents[i];
+        a.acc = { 0,0 };
+
+        // time-sliced agents keep last step's steering, unless an obstacle may need them now
+        bool obstacleDue = !obstacleSchedule || obstacleSchedule->due[i];
+        bool obstacleNear = s.enableObstacleAvoid && obstacleDue && !(occupancy && occupancy->clear[i]);
+        Vector2 finalSteer = { 0,0 };
+        if (timeSliced && (i + step) % 2 != 0 && !obstacleNear) finalSteer = shedder->steerCache[i];
+        else {
+            bc.agents++;
+            // compute component behaviors
+            Vector2 steerPath = { 0,0 };
+            if (s.enablePathFollowing) {
+                int waypoint = a.pathIndex;
+                Vector2 desired = PathFollowing(a, path, a.pathIndex, s.pathWaypointRadius);
+                steerPath = Sub(desired, a.vel);
+                if (a.pathIndex != waypoint && waypoint < (int)path.size()) EmitEvent(events, 0, EVENT_WAYPOINT_REACHED, (uint32_t)i, (uint32_t)waypoint, 0);
+            }
+
+            // LOD: far from the focus only path, obstacle and wall forces are kept
+            bool distant = lod && Length(Sub(a.pos, shedder->focus)) > LOAD_LOD_RADIUS;
+            Vector2 steerSep = { 0,0 };
+            if (s.enableSeparation && !distant) {
+                steerSep = farField ? SeparationFarField(a, agents, *farFieldGrid, s.separationRadius, s.separationStrength, s.farFieldTheta)
+                    : SeparationGrid(a, agents, grid, s.separationRadius, s.separationStrength, &bc.sepTested, &bc.sepAccepted);
+                queries++;
+                bc.sepActive += NonZero(steerSep);
+            }
+
+            Vector2 steerPredict = { 0,0 };
+            if (s.enablePredictiveAvoid && !distant && predictHalf && (i + step) % 2 != 0) steerPredict = shedder->predictCache[i];
+            else if (s.enablePredictiveAvoid && !distant) {
+                queries++;
+                ForEachGridNeighbor(grid, Sub(a.pos, predictBox), Add(a.pos, predictBox), [&](uint32_t j, bool wrapped) {
+                    if (j == i) return;
+                    bc.predictTested++;
+                    Vector2 f;
+                    if (!wrapped) f = PredictiveAvoidance(a, agents[j], s.predictiveLookAhead, s.predictiveStrength);
+                    else {
+                        Agent image = agents[j];
+                        image.pos = Sub(a.pos, MinImage(Sub(a.pos, image.pos), wrap));
+                        f = PredictiveAvoidance(a, image, s.predictiveLookAhead, s.predictiveStrength);
+                    }
+                    bc.predictActive += NonZero(f);
+                    steerPredict = Add(steerPredict, f);
+                });
+                bc.predictAgents += NonZero(steerPredict);
+            }
+            if (shedder) shedder->predictCache[i] = steerPredict;
+
+            Vector2 steerObs = { 0,0 };
+            if (obstacleNear) {
+                steerObs = ObstacleAvoidance(a, obsCenters, obsRadii, s.obstacleLookAhead, s.obstacleStrength);
+                if (obstacleSchedule) obstacleSchedule->evaluated++;
+                bc.obsEvaluated++;
+                bc.obsActive += NonZero(steerObs);
+            }
+
+            // predators steer for their target instead of the path, prey add evasion to the safety forces
+            Vector2 steerHunt = { 0,0 }, steerFlee = { 0,0 };
+            if (pursue) {
+                uint32_t& t = pursuit->target[i];
+                if ((i + step) % PURSUIT_REFRESH_STEPS == 0) {
+                    t = ChoosePursuitTarget(*pursuit, agents, count, grid, i, s.pursuitSenseRadius);
+                    pursuit->queries++;
+                }
+                else if (t != AGENT_NONE && (t >= count || Length(MinImage(Sub(agents[t].pos, a.pos), wrap)) > s.pursuitSenseRadius)) t = AGENT_NONE;
+                if (t != AGENT_NONE) {
+                    Vector2 targetPos = Add(a.pos, MinImage(Sub(agents[t].pos, a.pos), wrap));
+                    if (pursuit->team[i] == TEAM_PREDATOR) steerHunt = Sub(Pursue(a.pos, targetPos, agents[t].vel, a.maxSpeed), a.vel);
+                    else steerFlee = Sub(Evade(a.pos, targetPos, agents[t].vel, a.maxSpeed), a.vel);
+                }
+            }
+            Vector2 steerNav = NonZero(steerHunt) ? steerHunt : steerPath;
+
+            Vector2 steerWall = { 0,0 };
+            if (wallAvoid) steerWall = WallAvoidance(a, worldW, worldH, s.wallMargin, s.wallStrength);
+            bc.pathActive += NonZero(steerPath);
+            bc.wallActive += NonZero(steerWall);
+
+            if (trajectory && trajectory->file) {
+                uint32_t activeBits = (s.enablePathFollowing ? TRAJ_ACTIVE_PATH : 0u) | (s.enableSeparation ? TRAJ_ACTIVE_SEP : 0u)
+                    | (s.enablePredictiveAvoid ? TRAJ_ACTIVE_PREDICT : 0u) | (s.enableObstacleAvoid ? TRAJ_ACTIVE_OBS : 0u)
+                    | (wallAvoid ? TRAJ_ACTIVE_WALL : 0u) | (s.usePriority ? TRAJ_ACTIVE_PRIORITY : 0u);
+                ExportTrajectoryRow(*trajectory, (uint32_t)step, (uint32_t)i, activeBits, a, steerPath, steerSep, steerPredict, steerObs, steerWall);
+            }
+
+            // Combine - either priority or weighted blend (Task3)
+            if (s.usePriority) {
+                // priority order (highest -> lowest)
+                std::vector<Vector2> priorityForces;
+                priorityForces.push_back(Limit(Add(Scale(steerObs, 2.0f), Scale(steerWall, 1.8f)), a.maxForce)); // immediate danger
+                priorityForces.push_back(Limit(Add(Add(Scale(steerPredict, 1.4f), Scale(steerSep, 1.2f)), Scale(steerFlee, 1.3f)), a.maxForce)); // safety
+                priorityForces.push_back(Limit(Scale(steerNav, 0.9f), a.maxForce)); // navigation
+                size_t tier = TIER_NONE;
+                finalSteer = PrioritySteering(priorityForces, 0.001f, &tier);
+                bc.tier[tier]++;
+            }
+            else {
+                // weighted blending
+                std::vector<std::pair<Vector2, float>> wforces;
+                wforces.push_back({ steerObs, 1.8f });
+                wforces.push_back({ steerWall, 1.4f });
+                wforces.push_back({ steerPredict, 1.2f });
+                wforces.push_back({ steerFlee, 1.3f });
+                wforces.push_back({ steerSep, 1.0f });
+                wforces.push_back({ steerNav, 0.9f });
+                finalSteer = WeightedBlend(wforces, a.maxForce);
+            }
+            if (shedder) shedder->steerCache[i] = finalSteer;
+        }
+
+        // Apply as acceleration-like steering
+        finalSteer = Limit(finalSteer, a.maxForce);
+        a.vel = Add(a.vel, finalSteer);
+        a.vel = Limit(a.vel, a.maxSpeed);
+        Vector2 beforeMove = a.pos;
+        a.pos = Add(a.pos, a.vel);
+        if (!wrap.enabled) EmitWallHit(events, 0, (uint32_t)i, beforeMove, a.pos, Length(a.vel), worldW, worldH);
+
+        // simple wrap-around prevention:
+        Vector2 beforeWrap = a.pos;
+        WrapWorldPosition(a.pos, worldW, worldH, wrap);
+
+        // a wrap is a jump, not motion the schedule or the grid's slack accounted for
+        bool jumped = a.pos.x != beforeWrap.x || a.pos.y != beforeWrap.y;
+        if (jumped) {
+            NoteGridJump(grid, (uint32_t)i, a.pos);
+            if (farField) NoteGridJump(*farFieldGrid, (uint32_t)i, a.pos);
+        }
+        if (obstacleSchedule && (obstacleDue || jumped))
+            RescheduleObstacleEvent(*obstacleSchedule, (uint32_t)i, NextObstacleEvent(a, step + 1, obsCenters, obsRadii, s.obstacleLookAhead, contactMotion));
+    }
+    // the far-field walk would be timed as part of the tuned grid's cost, so don't sample while it runs
+    if (gridTuner && !(s.enableSeparation && farField))
+        GridTunerSample(*gridTuner, count, (NowSeconds() - neighbourStart) * 1000.0, queries, bc.sepTested + bc.predictTested);
+    if (counters) AddBehaviorCounters(*counters, bc);
+}
+
+// Far-field separation against the exact kernel on the current state, over up to maxSamples evenly spaced agents.
+// Errors are |approx - exact| / separationStrength, so 0 = identical and 2 = opposite directions.
+struct FarFieldReport {
+    size_t samples = 0;
+    double meanError = 0, maxError = 0;
+    double exactPairs = 0, farFieldInteractions = 0; // per sampled agent
+    double exactMs = 0, farFieldMs = 0;              // for the whole sample
+};
+
+FarFieldReport MeasureFarFieldError(const std::vector<Agent>& agents, const SteeringSettings& s, size_t maxSamples = 4096) {
+    FarFieldReport r;
+    if (agents.empty() || s.separationStrength <= 0) return r;
+    NeighborGrid exact, far;
+    BuildNeighborGrid(exact, agents, s.separationRadius, 0);
+    BuildNeighborGrid(far, agents, s.separationRadius / FAR_FIELD_CELLS_PER_RADIUS, 0);
+    BuildMassPyramid(far, agents);
+    size_t stride = std::max<size_t>(1, agents.size() / maxSamples);
+    std::vector<Vector2> reference;
+    size_t pairs = 0, interactions = 0;
+    double t0 = NowSeconds();
+    for (size_t i = 0; i < agents.size(); i += stride) {
+        Vector2 r2 = { s.separationRadius, s.separationRadius };
+        ForEachGridCandidate(exact, Sub(agents[i].pos, r2), Add(agents[i].pos, r2), [&](uint32_t) { pairs++; });
+        reference.push_back(SeparationGrid(agents[i], agents, exact, s.separationRadius, s.separationStrength));
+    }
+    double t1 = NowSeconds();
+    size_t k = 0;
+    for (size_t i = 0; i < agents.size(); i += stride, ++k) {
+        Vector2 approx = SeparationFarField(agents[i], agents, far, s.separationRadius, s.separationStrength, s.farFieldTheta, &interactions);
+        double e = Length(Sub(approx, reference[k])) / s.separationStrength;
+        r.meanError += e;
+        r.maxError = std::max(r.maxError, e);
+    }
+    double t2 = NowSeconds();
+    r.samples = reference.size();
+    r.meanError /= (double)r.samples;
+    r.exactPairs = (double)pairs / (double)r.samples;
+    r.farFieldInteractions = (double)interactions / (double)r.samples;
+    r.exactMs = (t1 - t0) * 1000.0;
+    r.farFieldMs = (t2 - t1) * 1000.0;
+    return r;
+}
+
+static void LogFarFieldReport(const std::vector<Agent>& agents, const SteeringSettings& s) {
+    FarFieldReport r = MeasureFarFieldError(agents, s);
+    TraceLog(LOG_INFO, "Far-field separation (theta %.2f, %zu samples): error mean %.4f max %.4f, interactions %.1f vs %.1f exact candidates, %.2f ms vs %.2f ms",
+        s.farFieldTheta, r.samples, r.meanError, r.maxError, r.farFieldInteractions, r.exactPairs, r.farFieldMs, r.exactMs);
+}
+
+// ---------- Continuum crowd ----------
+// For crowds too large for neighbour forces. Each step the agents are splatted onto a coarse grid as density and
+// mean velocity, density becomes a per-cell travel cost (crossing a cell slows down as it fills up, obstacle
+// cells are impassable), and one potential field per path waypoint is solved over that cost with fast
+// sweeping. Agents then steer down the potential gradient of their current waypoint at a speed set by the
+// density around them, so the per-agent cost does not depend on the crowd size.
+// Splatting accumulates fixed-point weights per worker and sums them per cell, so the fields (and the step)
+// come out the same for any thread count. Goals are solved in parallel, every other pass runs over cells or
+// agents in parallel.
+static const float CONTINUUM_FIXED = 65536.0f;
+static const float CONTINUUM_MIN_SPEED = 0.15f; // relative speed in a fully packed cell
+static const float CONTINUUM_BLOCKED = 1e30f;
+
+struct ContinuumField {
+    float cellSize = 16;
+    Vector2 origin = { 0,0 };
+    int cols = 0, rows = 0;
+    std::vector<float> density;                 // agents per cell (bilinear weights)
+    std::vector<float> flowX, flowY;            // density-weighted mean velocity
+    std::vector<float> cost;                    // time to cross a cell, CONTINUUM_BLOCKED inside obstacles
+    std::vector<std::vector<float>> potential;  // per goal
+    std::vector<int64_t> splat;                 // per worker: density, vx, vy per cell in CONTINUUM_FIXED units
+};
+
+static float ContinuumRelativeSpeed(float density, float maxDensity) {
+    return std::max(CONTINUUM_MIN_SPEED, 1.0f - density / maxDensity);
+}
+
+// Bilinear footprint of p over cell centres: the four cells and their weights, clamped to the grid
+static void ContinuumFootprint(const ContinuumField& f, Vector2 p, size_t cells[4], float weights[4]) {
+    float u = (p.x - f.origin.x) / f.cellSize - 0.5f, v = (p.y - f.origin.y) / f.cellSize - 0.5f;
+    if (!(u == u)) u = 0; // NaN
+    if (!(v == v)) v = 0;
+    u = std::min(std::max(u, 0.0f), (float)(f.cols - 1));
+    v = std::min(std::max(v, 0.0f), (float)(f.rows - 1));
+    int x0 = std::min((int)u, f.cols - 1), y0 = std::min((int)v, f.rows - 1);
+    int x1 = std::min(x0 + 1, f.cols - 1), y1 = std::min(y0 + 1, f.rows - 1);
+    float fx = u - x0, fy = v - y0;
+    cells[0] = (size_t)y0 * f.cols + x0; weights[0] = (1 - fx) * (1 - fy);
+    cells[1] = (size_t)y0 * f.cols + x1; weights[1] = fx * (1 - fy);
+    cells[2] = (size_t)y1 * f.cols + x0; weights[2] = (1 - fx) * fy;
+    cells[3] = (size_t)y1 * f.cols + x1; weights[3] = fx * fy;
+}
+
+static void SolvePotential(const ContinuumField& f, Vector2 goal, std::vector<float>& phi) {
+    size_t cells = (size_t)f.cols * f.rows;
+    phi.assign(cells, CONTINUUM_BLOCKED);
+    int gx = GridCoord(goal.x, f.origin.x, 1.0f / f.cellSize, f.cols), gy = GridCoord(goal.y, f.origin.y, 1.0f / f.cellSize, f.rows);
+    phi[(size_t)gy * f.cols + gx] = 0;
+    // Godunov upwind update, sweeping in the four diagonal orders; two rounds settle paths around obstacles
+    for (int round = 0; round < 2; ++round)
+        for (int dir = 0; dir < 4; ++dir) {
+            int sx = (dir & 1) ? -1 : 1, sy = (dir & 2) ? -1 : 1;
+            for (int j = 0; j < f.rows; ++j) {
+                int y = sy > 0 ? j : f.rows - 1 - j;
+                for (int i = 0; i < f.cols; ++i) {
+                    int x = sx > 0 ? i : f.cols - 1 - i;
+                    size_t c = (size_t)y * f.cols + x;
+                    float cost = f.cost[c];
+                    if (cost >= CONTINUUM_BLOCKED || phi[c] == 0) continue;
+                    float a = std::min(x > 0 ? phi[c - 1] : CONTINUUM_BLOCKED, x < f.cols - 1 ? phi[c + 1] : CONTINUUM_BLOCKED);
+                    float b = std::min(y > 0 ? phi[c - f.cols] : CONTINUUM_BLOCKED, y < f.rows - 1 ? phi[c + f.cols] : CONTINUUM_BLOCKED);
+                    float lo = std::min(a, b);
+                    if (lo >= CONTINUUM_BLOCKED) continue;
+                    float u = fabsf(a - b) >= cost ? lo + cost : 0.5f * (a + b + sqrtf(2 * cost * cost - (a - b) * (a - b)));
+                    if (u < phi[c]) phi[c] = u;
+                }
+            }
+        }
+}
+
+void BuildContinuumField(ContinuumField& f, const std::vector<Agent>& agents, const std::vector<Vector2>& goals,
+    const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii, float worldW, float worldH, const SteeringSettings& s) {
+    float maxDensity = s.continuumMaxDensity;
+    float wallBand = s.enableWallAvoid && !s.toroidalWorld ? s.wallMargin : 0.0f;
+    // the visible world only: routes through the off-screen margin would fight wall avoidance, and agents
+    // outside it sample the border cells, which lead back in
+    f.cellSize = std::max(s.continuumCellSize, 1.0f);
+    f.origin = { 0, 0 };
+    f.cols = std::max(1, (int)ceilf(worldW / f.cellSize));
+    f.rows = std::max(1, (int)ceilf(worldH / f.cellSize));
+    size_t cells = (size_t)f.cols * f.rows;
+    unsigned workers = WorkerCount();
+    f.splat.assign((size_t)workers * cells * 3, 0);
+    ParallelFor(agents.size(), [&](size_t b, size_t e, unsigned w) {
+        int64_t* acc = &f.splat[(size_t)w * cells * 3];
+        for (size_t i = b; i < e; ++i) {
+            size_t c[4];
+            float wt[4];
+            ContinuumFootprint(f, agents[i].pos, c, wt);
+            for (int k = 0; k < 4; ++k) {
+                float q = wt[k] * CONTINUUM_FIXED;
+                acc[c[k] * 3 + 0] += (int64_t)q;
+                acc[c[k] * 3 + 1] += (int64_t)(q * agents[i].vel.x);
+                acc[c[k] * 3 + 2] += (int64_t)(q * agents[i].vel.y);
+            }
+        }
+    }, 16384);
+
+    f.density.resize(cells);
+    f.flowX.resize(cells);
+    f.flowY.resize(cells);
+    f.cost.resize(cells);
+    ParallelFor(cells, [&](size_t b, size_t e, unsigned) {
+        for (size_t c = b; c < e; ++c) {
+            int64_t d = 0, vx = 0, vy = 0;
+            for (unsigned w = 0; w < workers; ++w) {
+                const int64_t* acc = &f.splat[((size_t)w * cells + c) * 3];
+                d += acc[0]; vx += acc[1]; vy += acc[2];
+            }
+            f.density[c] = (float)d / CONTINUUM_FIXED;
+            f.flowX[c] = d ? (float)vx / (float)d : 0.0f;
+            f.flowY[c] = d ? (float)vy / (float)d : 0.0f;
+            Vector2 centre = { f.origin.x + ((float)(c % f.cols) + 0.5f) * f.cellSize, f.origin.y + ((float)(c / f.cols) + 0.5f) * f.cellSize };
+            bool blocked = false;
+            for (size_t o = 0; o < obsCenters.size() && !blocked; ++o) blocked = Length(Sub(centre, obsCenters[o])) < obsRadii[o];
+            // discomfort in the band wall avoidance keeps clear, or the empty band looks like the fastest lane
+            float edge = std::min(std::min(centre.x, worldW - centre.x), std::min(centre.y, worldH - centre.y));
+            float discomfort = edge < wallBand ? 4.0f * (1.0f - edge / wallBand) : 0.0f;
+            f.cost[c] = blocked ? CONTINUUM_BLOCKED : (1.0f + discomfort) / ContinuumRelativeSpeed(f.density[c], maxDensity);
+        }
+    }, 4096);
+
+    f.potential.resize(goals.size());
+    ParallelFor(goals.size(), [&](size_t b, size_t e, unsigned) {
+        for (size_t g = b; g < e; ++g) SolvePotential(f, goals[g], f.potential[g]);
+    }, 1);
+}
+
+// Downhill direction of phi at p (unit length, or zero on a plateau / inside an obstacle)
+static Vector2 ContinuumDirection(const ContinuumField& f, const std::vector<float>& phi, Vector2 p) {
+    float inv = 1.0f / f.cellSize;
+    int x = GridCoord(p.x, f.origin.x, inv, f.cols), y = GridCoord(p.y, f.origin.y, inv, f.rows);
+    size_t c = (size_t)y * f.cols + x;
+    float centre = phi[c];
+    if (centre >= CONTINUUM_BLOCKED) return { 0,0 };
+    // central differences, one-sided next to blocked cells and the border
+    auto slope = [&](float lo, float hi) {
+        bool hasLo = lo < CONTINUUM_BLOCKED, hasHi = hi < CONTINUUM_BLOCKED;
+        if (hasLo && hasHi) return 0.5f * (hi - lo);
+        if (hasHi) return hi - centre;
+        if (hasLo) return centre - lo;
+        return 0.0f;
+    };
+    float gx = slope(x > 0 ? phi[c - 1] : CONTINUUM_BLOCKED, x < f.cols - 1 ? phi[c + 1] : CONTINUUM_BLOCKED);
+    float gy = slope(y > 0 ? phi[c - f.cols] : CONTINUUM_BLOCKED, y < f.rows - 1 ? phi[c + f.cols] : CONTINUUM_BLOCKED);
+    return Normalize({ -gx, -gy });
+}
+
+// Continuum replacement for StepAgents: path following comes from the fields, separation and predictive
+// avoidance from the density cost; obstacle and wall avoidance still apply per agent, the former screened by the
+// occupancy bitmap when there is one. Counters, if given, are added to; events (waypoints and wall hits) go to
+// the buffers of the workers that moved the agents.
+void StepContinuum(std::vector<Agent>& agents, ContinuumField& field, NeighborGrid& grid, ObstacleBitmap* occupancy, BehaviorCounters* counters,
+    EventStream* events, const std::vector<Vector2>& path,
+    const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii, const SteeringSettings& s, float worldW, float worldH,
+    uint64_t step, TrajectoryExporter* trajectory) {
+    float vmax = 0;
+    for (const Agent& a : agents) vmax = std::max(vmax, std::max(a.maxSpeed, Length(a.vel)));
+    WorldWrap wrap = WorldWrapFor(s, worldW, worldH);
+    bool wallAvoid = s.enableWallAvoid && !wrap.enabled;
+    BuildNeighborGrid(grid, agents, s.separationRadius, vmax, wrap); // keeps the spatial queries current
+    BuildContinuumField(field, agents, path, obsCenters, obsRadii, worldW, worldH, s);
+    if (occupancy && s.enableObstacleAvoid) {
+        UpdateObstacleBitmap(*occupancy, obsCenters, obsRadii, s.obstacleLookAhead, worldW, worldH);
+        occupancy->clear.resize(agents.size());
+    }
+    bool exporting = trajectory && trajectory->file;
+    uint32_t activeBits = TRAJ_ACTIVE_CONTINUUM | (s.enablePathFollowing ? TRAJ_ACTIVE_PATH : 0u)
+        | (s.enableObstacleAvoid ? TRAJ_ACTIVE_OBS : 0u) | (wallAvoid ? TRAJ_ACTIVE_WALL : 0u);
+    // rows go to the exporter in agent order, so exporting runs on one thread
+    std::vector<BehaviorCounters> workerCounts(WorkerCount());
+    std::vector<std::vector<uint32_t>> workerJumps(WorkerCount()); // wrapped agents, patched into the grid afterwards
+    ParallelFor(agents.size(), [&](size_t b, size_t e, unsigned w) {
+        BehaviorCounters bc;
+        bc.agents = e - b;
+        if (occupancy && s.enableObstacleAvoid) MarkObstacleClearAgents(*occupancy, agents, b, e);
+        for (size_t i = b; i < e; ++i) {
+            Agent& a = agents[i];
+            Vector2 steerField = { 0,0 };
+            if (s.enablePathFollowing && !path.empty()) {
+                if (a.pathIndex >= (int)path.size() || a.pathIndex < 0) a.pathIndex = 0;
+                if (Length(Sub(path[a.pathIndex], a.pos)) < s.pathWaypointRadius) {
+                    EmitEvent(events, w, EVENT_WAYPOINT_REACHED, (uint32_t)i, (uint32_t)a.pathIndex, 0);
+                    a.pathIndex = (a.pathIndex + 1) % (int)path.size();
+                }
+                size_t c[4];
+                float wt[4];
+                ContinuumFootprint(field, a.pos, c, wt);
+                float density = 0;
+                for (int k = 0; k < 4; ++k) density += wt[k] * field.density[c[k]];
+                float speed = a.maxSpeed * ContinuumRelativeSpeed(density, s.continuumMaxDensity);
+                Vector2 desired = Scale(ContinuumDirection(field, field.potential[a.pathIndex], a.pos), speed);
+                steerField = Sub(desired, a.vel);
+            }
+            Vector2 steerObs = { 0,0 };
+            if (s.enableObstacleAvoid && !(occupancy && occupancy->clear[i])) {
+                steerObs = ObstacleAvoidance(a, obsCenters, obsRadii, s.obstacleLookAhead, s.obstacleStrength);
+                bc.obsEvaluated++;
+                bc.obsActive += NonZero(steerObs);
+            }
+            Vector2 steerWall = { 0,0 };
+            if (wallAvoid) steerWall = WallAvoidance(a, worldW, worldH, s.wallMargin, s.wallStrength);
+            bc.pathActive += NonZero(steerField);
+            bc.wallActive += NonZero(steerWall);
+            if (exporting) ExportTrajectoryRow(*trajectory, (uint32_t)step, (uint32_t)i, activeBits, a, steerField, { 0,0 }, { 0,0 }, steerObs, steerWall);
+
+            Vector2 finalSteer = Add(Add(Scale(steerObs, 2.0f), Scale(steerWall, 1.8f)), steerField);
+            a.vel = Limit(Add(a.vel, Limit(finalSteer, a.maxForce)), a.maxSpeed);
+            Vector2 beforeMove = a.pos;
+            a.pos = Add(a.pos, a.vel);
+            if (!wrap.enabled) EmitWallHit(events, w, (uint32_t)i, beforeMove, a.pos, Length(a.vel), worldW, worldH);
+            Vector2 beforeWrap = a.pos;
+            WrapWorldPosition(a.pos, worldW, worldH, wrap);
+            if (a.pos.x != beforeWrap.x || a.pos.y != beforeWrap.y) workerJumps[w].push_back((uint32_t)i);
+        }
+        AddBehaviorCounters(workerCounts[w], bc);
+    }, exporting ? std::max<size_t>(agents.size(), 1) : 4096);
+    for (const std::vector<uint32_t>& jumps : workerJumps)
+        for (uint32_t i : jumps) NoteGridJump(grid, i, agents[i].pos);
+    if (counters)
+        for (const BehaviorCounters& bc : workerCounts) AddBehaviorCounters(*counters, bc);
+}
+
+// ---------- Contact solver ----------
+// Optional position-based pass after integration: agents are discs of agentRadius and must not overlap each
+// other or the obstacles. Each iteration collects, for every agent, the corrections from all its violated
+// contacts (half the overlap per agent pair, the full overlap against an obstacle) from read-only positions,
+// averages them with over-relaxation and applies them all at once, so iterations are Jacobi style and run in
+// parallel without races. The cost is a fixed contactIterations grid builds plus neighbour passes per step;
+// velocities are left to steering.
+static const float CONTACT_RELAXATION = 1.5f;
+
+struct ContactSolver {
+    std::vector<Vector2> delta;
+    std::vector<float> workerOverlap;
+    std::vector<uint32_t> workerPairs;
+    float maxOverlap = 0; // deepest contact seen by the last iteration, before its correction
+    uint32_t contacts = 0; // violated contacts in the last iteration
+    double ms = 0;
+};
+
+void SolveContacts(ContactSolver& cs, std::vector<Agent>& agents, size_t count, NeighborGrid& grid, const std::vector<Vector2>& obsCenters,
+    const std::vector<float>& obsRadii, const SteeringSettings& s, float worldW, float worldH) {
+    double t0 = NowSeconds();
+    float r = s.agentRadius, minDist = 2.0f * r;
+    WorldWrap wrap = WorldWrapFor(s, worldW, worldH);
+    Vector2 box = { minDist, minDist };
+    cs.delta.resize(count);
+    for (int iter = 0; iter < s.contactIterations; ++iter) {
+        // slack r: no correction moves an agent further, so the grid stays valid for queries afterwards
+        BuildNeighborGrid(grid, agents, minDist, r, wrap);
+        cs.workerOverlap.assign(WorkerCount(), 0.0f);
+        cs.workerPairs.assign(WorkerCount(), 0);
+        ParallelFor(count, [&](size_t b, size_t e, unsigned w) {
+            for (size_t i = b; i < e; ++i) {
+                const Agent& a = agents[i];
+                Vector2 sum = { 0,0 };
+                int n = 0;
+                ForEachGridNeighbor(grid, Sub(a.pos, box), Add(a.pos, box), [&](uint32_t j, bool wrapped) {
+                    if (j == i) return;
+                    Vector2 diff = Sub(a.pos, agents[j].pos);
+                    if (wrapped) diff = MinImage(diff, wrap);
+                    float d = Length(diff);
+                    if (d >= minDist) return;
+                    // coincident agents: split along a direction fixed by the pair so both sides agree
+                    Vector2 dir = d > 1e-4f ? Scale(diff, 1.0f / d) : (i < j ? Vector2{ 1,0 } : Vector2{ -1,0 });
+                    sum = Add(sum, Scale(dir, 0.5f * (minDist - d)));
+                    cs.workerOverlap[w] = std::max(cs.workerOverlap[w], minDist - d);
+                    cs.workerPairs[w]++;
+                    n++;
+                });
+                for (size_t o = 0; o < obsCenters.size(); ++o) {
+                    Vector2 diff = Sub(a.pos, obsCenters[o]);
+                    float d = Length(diff), limit = obsRadii[o] + r;
+                    if (d >= limit) continue;
+                    Vector2 dir = d > 1e-4f ? Scale(diff, 1.0f / d) : Vector2{ 0,-1 };
+                    sum = Add(sum, Scale(dir, limit - d));
+                    cs.workerOverlap[w] = std::max(cs.workerOverlap[w], limit - d);
+                    cs.workerPairs[w]++;
+                    n++;
+                }
+                cs.delta[i] = n ? Limit(Scale(sum, CONTACT_RELAXATION / (float)n), r) : Vector2{ 0,0 };
+            }
+        }, 2048);
+        cs.maxOverlap = *std::max_element(cs.workerOverlap.begin(), cs.workerOverlap.end());
+        cs.contacts = 0;
+        for (uint32_t p : cs.workerPairs) cs.contacts += p;
+        if (cs.contacts == 0) break;
+        ParallelFor(count, [&](size_t b, size_t e, unsigned) {
+            for (size_t i = b; i < e; ++i) {
+                agents[i].pos = Add(agents[i].pos, cs.delta[i]);
+                if (wrap.enabled) WrapWorldPosition(agents[i].pos, worldW, worldH, wrap);
+            }
+        }, 8192);
+    }
+    cs.ms = (NowSeconds() - t0) * 1000.0;
+}
+
+// ---------- NaN quarantine ----------
+// After every step the agents' float state is scanned for NaN/Inf (one SSE compare covers pos+vel, another
+// acc+limits). Bad agents are reset at their current waypoint, or `home` without a path, before the value can
+// spread through the neighbour forces, and counted.
+struct QuarantineStats {
+    uint32_t lastStep = 0; // agents reset by the most recent scan
+    uint64_t total = 0;
+    std::vector<std::vector<uint32_t>> found; // per worker scratch
+};
+
+static_assert(offsetof(Agent, vel) == offsetof(Agent, pos) + 8 && offsetof(Agent, acc) == offsetof(Agent, pos) + 16
+    && offsetof(Agent, maxSpeed) == offsetof(Agent, pos) + 24 && offsetof(Agent, maxForce) == offsetof(Agent, pos) + 28,
+    "AgentFinite reads pos..maxForce as eight consecutive floats");
+
+static bool AgentFinite(const Agent& a) {
+#if defined(STEER_SSE2)
+    // x - x is 0 for finite x and NaN for NaN/Inf
+    __m128 v0 = _mm_loadu_ps(&a.pos.x), v1 = _mm_loadu_ps(&a.acc.x);
+    __m128 d0 = _mm_sub_ps(v0, v0), d1 = _mm_sub_ps(v1, v1);
+    return _mm_movemask_ps(_mm_cmpord_ps(d0, d1)) == 0xF;
+#else
+    const float* f = &a.pos.x;
+    for (int i = 0; i < 8; ++i)
+        if (!std::isfinite(f[i])) return false;
+    return true;
+#endif
+}
+
+static void ResetAgent(Agent& a, const std::vector<Vector2>& path, Vector2 home) {
+    if (!std::isfinite(a.pos.x) || !std::isfinite(a.pos.y)) {
+        if (!path.empty()) a.pos = path[(size_t)std::max(a.pathIndex, 0) % path.size()];
+        else a.pos = home;
+    }
+    a.vel = { 0,0 };
+    a.acc = { 0,0 };
+    if (!std::isfinite(a.maxSpeed) || a.maxSpeed <= 0) a.maxSpeed = 2.5f;
+    if (!std::isfinite(a.maxForce) || a.maxForce <= 0) a.maxForce = 0.14f;
+}
+
+// Returns the number of agents reset
+uint32_t QuarantineAgents(std::vector<Agent>& agents, size_t count, const std::vector<Vector2>& path, Vector2 home, QuarantineStats& qs) {
+    qs.found.resize(WorkerCount());
+    for (std::vector<uint32_t>& f : qs.found) f.clear();
+    ParallelFor(count, [&](size_t b, size_t e, unsigned w) {
+        for (size_t i = b; i < e; ++i)
+            if (!AgentFinite(agents[i])) qs.found[w].push_back((uint32_t)i);
+    }, 16384);
+    uint32_t n = 0;
+    for (const std::vector<uint32_t>& f : qs.found)
+        for (uint32_t i : f) { ResetAgent(agents[i], path, home); n++; }
+    qs.lastStep = n;
+    qs.total += n;
+    if (n) TraceLog(LOG_WARNING, "Quarantined %u agent(s) with NaN/Inf state (%llu so far)", n, (unsigned long long)qs.total);
+    return n;
+}
+
+// ---------- Multi-process domain decomposition ----------
+// `--domains N` splits the world into N vertical strips, one process each (the launching process runs
+// strip 0 and spawns the others). Processes share one mapping holding, per domain, a ghost buffer
+// (owned agents within ghostWidth of an inner strip edge) and an inbox for agents migrating into the strip.
+// Each step: drain inbox -> publish ghosts -> barrier -> step owned agents with neighbour ghosts visible ->
+// post emigrants to their new domain's inbox -> barrier. Ghosts are read-only copies and never migrate.
+static const char DOMAIN_MAGIC[8] = { 'S','T','E','E','R','D','O','M' };
+static const uint32_t DOMAIN_VERSION = 1;
+static const double DOMAIN_BARRIER_TIMEOUT = 30.0; // seconds, guards against a crashed peer
+
+struct DomainShared {
+    char magic[8];
+    uint32_t version;
+    uint32_t domainCount;
+    uint32_t capacity;      // agents per ghost buffer / inbox
+    uint32_t slotBytes;
+    float worldW, worldH;
+    float ghostWidth;
+    uint32_t pad;
+    uint64_t steps;
+    std::atomic<uint32_t> arrived;
+    std::atomic<uint32_t> generation;
+    std::atomic<uint32_t> failed;
+};
+
+// Followed by Agent ghosts[capacity] and Agent inbox[capacity]
+struct DomainSlot {
+    std::atomic<uint32_t> ghostCount;
+    std::atomic<uint32_t> inboxCount;
+    uint32_t owned;     // final owned count, for the conservation check
+    uint32_t migrated;  // agents this domain sent away
+    double totalStepMs;
+    double maxStepMs;
+};
+
+static size_t DomainHeaderBytes() { return (size_t)AlignUp(sizeof(DomainShared), 64); }
+static DomainSlot* DomainSlotAt(DomainShared* d, uint32_t index) {
+    return (DomainSlot*)((char*)d + DomainHeaderBytes() + (size_t)index * d->slotBytes);
+}
+static Agent* DomainGhosts(DomainSlot* s) { return (Agent*)(s + 1); }
+static Agent* DomainInbox(DomainShared* d, DomainSlot* s) { return (Agent*)(s + 1) + d->capacity; }
+
+static uint32_t DomainOf(const DomainShared* d, float x) {
+    float f = x / d->worldW * (float)d->domainCount;
+    if (!(f > 0)) return 0;
+    return f >= (float)d->domainCount ? d->domainCount - 1 : (uint32_t)f;
+}
+
+// Process-shared generation barrier; false if a peer failed or the wait timed out
+static bool DomainBarrier(DomainShared* d) {
+    uint32_t gen = d->generation.load(std::memory_order_acquire);
+    if (d->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == d->domainCount) {
+        d->arrived.store(0, std::memory_order_relaxed);
+        d->generation.fetch_add(1, std::memory_order_release);
+        return d->failed.load(std::memory_order_relaxed) == 0;
+    }
+    double t0 = NowSeconds();
+    unsigned spins = 0;
+    while (d->generation.load(std::memory_order_acquire) == gen) {
+        if (d->failed.load(std::memory_order_relaxed)) return false;
+        if (++spins > 1000) {
+            std::this_thread::yield();
+            if ((spins & 1023) == 0 && NowSeconds() - t0 > DOMAIN_BARRIER_TIMEOUT) { d->failed.store(1); return false; }
+        }
+    }
+    return d->failed.load(std::memory_order_relaxed) == 0;
+}
+
+static float DomainGhostWidth(const SteeringSettings& s, float maxSpeed) {
+    // farthest a neighbour can matter: separation radius, or both agents' look-ahead plus the 24 px combined radius
+    float predictive = 2.0f * maxSpeed * s.predictiveLookAhead + 24.0f;
+    return std::max(s.separationRadius, predictive) + 2.0f * maxSpeed; // + one step of motion
+}
+
+struct ProcessHandle {
+#if defined(_WIN32)
+    HANDLE process = nullptr;
+#else
+    pid_t pid = -1;
+#endif
+};
+
+static bool SpawnSelf(const char* argv0, const std::vector<std::string>& args, ProcessHandle& out) {
+#if defined(_WIN32)
+    (void)argv0;
+    char exe[MAX_PATH];
+    if (!GetModuleFileNameA(nullptr, exe, MAX_PATH)) return false;
+    std::string cmd = std::string("\"") + exe + "\"";
+    for (const std::string& a : args) cmd += " \"" + a + "\"";
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    if (!CreateProcessA(exe, &cmd[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi)) return false;
+    CloseHandle(pi.hThread);
+    out.process = pi.hProcess;
+    return true;
+#else
+    std::vector<char*> argv;
+    argv.push_back((char*)argv0);
+    for (const std::string& a : args) argv.push_back((char*)a.c_str());
+    argv.push_back(nullptr);
+#if defined(__linux__)
+    const char* exe = "/proc/self/exe";
+#else
+    const char* exe = argv0;
+#endif
+    return posix_spawn(&out.pid, exe, nullptr, nullptr, argv.data(), environ) == 0;
+#endif
+}
+
+// Shared memory name for one --domains run: the pid keeps concurrent launchers apart, the counter
+// repeated runs in one process and the clock a stale segment left behind by a crashed process with a reused pid
+static std::string DomainShmName() {
+    static std::atomic<uint32_t> launches{ 0 };
+#if defined(_WIN32)
+    unsigned long long pid = GetCurrentProcessId();
+#else
+    unsigned long long pid = (unsigned long long)getpid();
+#endif
+    unsigned long long ticks = (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count();
+    return "steering_domains_" + std::to_string(pid) + "_" + std::to_string(launches.fetch_add(1)) + "_" + std::to_string(ticks % 1000000007ull);
+}
+
+static bool WaitProcess(ProcessHandle& p) {
+#if defined(_WIN32)
+    DWORD code = 1;
+    WaitForSingleObject(p.process, INFINITE);
+    GetExitCodeProcess(p.process, &code);
+    CloseHandle(p.process);
+    return code == 0;
+#else
+    int status = 0;
+    return waitpid(p.pid, &status, 0) == p.pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+// Runs one domain until shared->steps steps are done; shared by the launcher and the spawned workers
+static bool RunDomainLoop(DomainShared* d, uint32_t index, const std::vector<Vector2>& path, const std::vector<Vector2>& obsCenters,
+    const std::vector<float>& obsRadii, const SteeringSettings& settings) {
+    DomainSlot* self = DomainSlotAt(d, index);
+    float x0 = d->worldW * index / d->domainCount, x1 = d->worldW * (index + 1) / d->domainCount;
+    bool hasLeft = index > 0, hasRight = index + 1 < d->domainCount;
+    std::vector<Agent> local;
+    NeighborGrid grid;
+    QuarantineStats quarantine;
+    size_t owned = 0;
+    self->migrated = 0;
+    self->totalStepMs = self->maxStepMs = 0;
+
+    for (uint64_t step = 1; step <= d->steps; ++step) {
+        // agents that arrived last step (or the initial distribution)
+        uint32_t arrivals = std::min(self->inboxCount.load(std::memory_order_acquire), d->capacity);
+        local.resize(owned);
+        local.insert(local.end(), DomainInbox(d, self), DomainInbox(d, self) + arrivals);
+        self->inboxCount.store(0, std::memory_order_relaxed);
+        owned = local.size();
+
+        uint32_t ghosts = 0;
+        Agent* ghostOut = DomainGhosts(self);
+        for (size_t i = 0; i < owned && ghosts < d->capacity; ++i) {
+            float x = local[i].pos.x;
+            if ((hasLeft && x < x0 + d->ghostWidth) || (hasRight && x >= x1 - d->ghostWidth)) ghostOut[ghosts++] = local[i];
+        }
+        self->ghostCount.store(ghosts, std::memory_order_release);
+        if (!DomainBarrier(d)) return false;
+
+        double t0 = NowSeconds();
+        for (int side = -1; side <= 1; side += 2) {
+            if ((side < 0 && !hasLeft) || (side > 0 && !hasRight)) continue;
+            DomainSlot* n = DomainSlotAt(d, index + side);
+            const Agent* g = DomainGhosts(n);
+            uint32_t count = n->ghostCount.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < count; ++i) {
+                float x = g[i].pos.x;
+                if (x >= x0 - d->ghostWidth && x < x1 + d->ghostWidth) local.push_back(g[i]);
+            }
+        }
+        StepAgents(local, owned, grid, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, path, obsCenters, obsRadii, settings, d->worldW, d->worldH, step, nullptr);
+        local.resize(owned);
+        QuarantineAgents(local, owned, path, { (x0 + x1) * 0.5f, d->worldH * 0.5f }, quarantine);
+
+        // hand agents that left the strip to their new owner; if its inbox is full keep them one more step
+        size_t kept = 0;
+        for (size_t i = 0; i < owned; ++i) {
+            uint32_t target = DomainOf(d, local[i].pos.x);
+            if (target != index) {
+                DomainSlot* t = DomainSlotAt(d, target);
+                uint32_t at = t->inboxCount.fetch_add(1, std::memory_order_relaxed);
+                if (at < d->capacity) {
+                    DomainInbox(d, t)[at] = local[i];
+                    self->migrated++;
+                    continue;
+                }
+                t->inboxCount.fetch_sub(1, std::memory_order_relaxed);
+            }
+            local[kept++] = local[i];
+        }
+        owned = kept;
+        double ms = (NowSeconds() - t0) * 1000.0;
+        self->totalStepMs += ms;
+        self->maxStepMs = std::max(self->maxStepMs, ms);
+        if (!DomainBarrier(d)) return false;
+    }
+    owned += std::min(self->inboxCount.load(std::memory_order_acquire), d->capacity);
+    self->owned = (uint32_t)owned;
+    return DomainBarrier(d);
+}
+
+int RunDomainWorker(const char* shmName, uint32_t index, const std::vector<Vector2>& path, const std::vector<Vector2>& obsCenters,
+    const std::vector<float>& obsRadii, const SteeringSettings& settings) {
+    SharedMapping shm;
+    if (!SharedMappingOpen(shm, shmName, true)) {
+        TraceLog(LOG_ERROR, "Domain %u: cannot open %s", index, shmName);
+        return 1;
+    }
+    DomainShared* d = (DomainShared*)shm.base;
+    bool ok = shm.bytes >= sizeof(DomainShared) && memcmp(d->magic, DOMAIN_MAGIC, sizeof(d->magic)) == 0
+        && d->version == DOMAIN_VERSION && index < d->domainCount
+        && DomainHeaderBytes() + (size_t)d->slotBytes * d->domainCount <= shm.bytes;
+    ok = ok && RunDomainLoop(d, index, path, obsCenters, obsRadii, settings);
+    if (!ok && shm.bytes >= sizeof(DomainShared)) d->failed.store(1);
+    SharedMappingClose(shm);
+    return ok ? 0 : 1;
+}
+
+// Launcher: distributes `agents` over the strips, spawns domains 1..N-1 as child processes, runs domain 0.
+// The children rebuild the world from the same seed and scenario file, so their path and obstacles match this one.
+int RunDomains(const char* argv0, uint32_t domainCount, uint64_t steps, const std::vector<Agent>& agents, const std::vector<Vector2>& path,
+    const std::vector<Vector2>& obsCenters, const std::vector<float>& obsRadii, const SteeringSettings& settings, float worldW, float worldH,
+    uint32_t seed, const char* scenarioFile) {
+    float maxSpeed = 0;
+    for (const Agent& a : agents) maxSpeed = std::max(maxSpeed, a.maxSpeed);
+    uint32_t capacity = (uint32_t)std::max<size_t>(agents.size(), 1024);
+    uint64_t slotBytes = AlignUp(sizeof(DomainSlot) + 2ull * capacity * sizeof(Agent), 64);
+    if (domainCount == 0 || slotBytes > 0xFFFFFFFFull) return 1;
+
+    std::string shmName = DomainShmName();
+    SharedMapping shm;
+    if (!SharedMappingCreate(shm, shmName.c_str(), DomainHeaderBytes() + (size_t)slotBytes * domainCount)) {
+        TraceLog(LOG_ERROR, "Cannot create shared memory for %u domains", domainCount);
+        return 1;
+    }
+    DomainShared* d = new (shm.base) DomainShared();
+    memcpy(d->magic, DOMAIN_MAGIC, sizeof(d->magic));
+    d->version = DOMAIN_VERSION;
+    d->domainCount = domainCount;
+    d->capacity = capacity;
+    d->slotBytes = (uint32_t)slotBytes;
+    d->worldW = worldW;
+    d->worldH = worldH;
+    d->ghostWidth = DomainGhostWidth(settings, maxSpeed);
+    d->steps = steps;
+    for (uint32_t i = 0; i < domainCount; ++i) new (DomainSlotAt(d, i)) DomainSlot();
+    for (const Agent& a : agents) {
+        DomainSlot* s = DomainSlotAt(d, DomainOf(d, a.pos.x));
+        DomainInbox(d, s)[s->inboxCount.fetch_add(1)] = a;
+    }
+
+    std::vector<ProcessHandle> children(domainCount);
+    bool ok = true;
+    for (uint32_t i = 1; i < domainCount && ok; ++i) {
+        std::vector<std::string> args = { "--domain-shm", shmName, "--domain-worker", std::to_string(i),
+            "--seed", std::to_string(seed), "--scenario", scenarioFile };
+        ok = SpawnSelf(argv0, args, children[i]);
+        if (!ok) {
+            TraceLog(LOG_ERROR, "Could not start domain process %u", i);
+            d->failed.store(1);
+            children.resize(i);
+        }
+    }
+    double t0 = NowSeconds();
+    ok = ok && RunDomainLoop(d, 0, path, obsCenters, obsRadii, settings);
+    if (!ok) d->failed.store(1);
+    double wallMs = (NowSeconds() - t0) * 1000.0;
+    for (size_t i = 1; i < children.size(); ++i) ok = WaitProcess(children[i]) && ok;
+
+    if (ok) {
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < domainCount; ++i) {
+            DomainSlot* s = DomainSlotAt(d, i);
+            total += s->owned;
+            TraceLog(LOG_INFO, "Domain %u: %u agents, %u migrated out, avg step %.3f ms, max %.3f ms", i, s->owned, s->migrated,
+                s->totalStepMs / (double)std::max<uint64_t>(steps, 1), s->maxStepMs);
+        }
+        TraceLog(total == agents.size() ? LOG_INFO : LOG_ERROR, "Domains: %u processes, %llu steps in %.1f ms, %llu/%d agents accounted for",
+            domainCount, (unsigned long long)steps, wallMs, (unsigned long long)total, (int)agents.size());
+        ok = total == agents.size();
+    }
+    else {
+        TraceLog(LOG_ERROR, "Domain run failed");
+    }
+    SharedMappingClose(shm);
+    return ok ? 0 : 1;
+}
+
+// ---------- Control socket ----------
+// `--control <path>` listens on a Unix-domain stream socket for a test harness. Messages are little endian,
+// each starting with ControlHeader (size includes the header); every request gets exactly one reply with the
+// same opcode and id. The socket is only serviced between steps: everything that arrived is parsed and
+// executed in one go and the replies are sent back in one write, so many small queries cost one syscall pair.
+//
+//   CTRL_PAUSE       u8 paused                      -> -
+//   CTRL_STEP        u32 steps (runs while paused)  -> -
+//   CTRL_SET_TOGGLE  u8 toggle, u8 value            -> -
+//   CTRL_GET_TOGGLES                                -> u32 toggle bits
+//   CTRL_SET_PARAM   u8 param, f32 value            -> -
+//   CTRL_GET_PARAM   u8 param                       -> f32 value
+//   CTRL_SPAWN       u32 count, f32 x0 y0 x1 y1     -> u32 agent count (count at most CONTROL_MAX_SPAWN)
+//                    [ControlSpawnTail]             optional, sets the rest of the ScenarioSpawn
+//   CTRL_STATS                                      -> ControlStats
+//   CTRL_QUIT                                       -> -
+//   CTRL_EVENTS      u8 type, u32 first             -> u64 step, u32 total, SimEvent[] from first (as many as fit)
+//
+// CTRL_SET_TOGGLE, CTRL_SET_PARAM and CTRL_SPAWN change the simulation. When the input log is recorded, the ones
+// that succeed are journaled and logged with the next step, and --replay-input runs them again before that step.
+#if defined(_WIN32)
+typedef SOCKET ControlSocket;
+static const ControlSocket CONTROL_INVALID_SOCKET = INVALID_SOCKET;
+static void CloseControlSocket(ControlSocket s) { closesocket(s); }
+#else
+typedef int ControlSocket;
+static const ControlSocket CONTROL_INVALID_SOCKET = -1;
+static void CloseControlSocket(ControlSocket s) { close(s); }
+#endif
+#if defined(MSG_NOSIGNAL)
+static const int CONTROL_SEND_FLAGS = MSG_NOSIGNAL; // a harness that hangs up must not SIGPIPE the sim
+#else
+static const int CONTROL_SEND_FLAGS = 0;
+#endif
+
+enum ControlOp : uint8_t {
+    CTRL_PAUSE = 1, CTRL_STEP, CTRL_SET_TOGGLE, CTRL_GET_TOGGLES, CTRL_SET_PARAM, CTRL_GET_PARAM, CTRL_SPAWN, CTRL_STATS, CTRL_QUIT, CTRL_EVENTS
+};
+enum ControlStatus : uint8_t { CTRL_OK = 0, CTRL_BAD_REQUEST = 1, CTRL_UNKNOWN_OP = 2 };
+enum ControlToggle : uint8_t {
+    CTRL_TOGGLE_PATH, CTRL_TOGGLE_SEPARATION, CTRL_TOGGLE_PREDICTIVE, CTRL_TOGGLE_OBSTACLE, CTRL_TOGGLE_WALL,
+    CTRL_TOGGLE_PRIORITY, CTRL_TOGGLE_SINGLE_AGENT, CTRL_TOGGLE_DRAW_DEBUG, CTRL_TOGGLE_FAR_FIELD, CTRL_TOGGLE_CONTINUUM, CTRL_TOGGLE_CONTACTS, CTRL_TOGGLE_TOROIDAL, CTRL_TOGGLE_PURSUIT, CTRL_TOGGLE_COUNT
+};
+
+#pragma pack(push, 1)
+struct ControlHeader {
+    uint16_t size;
+    uint8_t op;
+    uint8_t status; // 0 in requests
+    uint32_t id;
+};
+struct ControlStats {
+    uint64_t step;
+    uint32_t agentCount;
+    uint8_t paused;
+    uint8_t pad[3];
+    float lastStepMs;
+    float avgStepMs;
+    uint64_t quarantined; // agents reset for NaN/Inf state since start
+    BehaviorCounters behavior; // of the last step
+    uint32_t loadLevel; // LoadLevel in effect
+};
+// CTRL_SPAWN payloads are versioned by length: 20 bytes take the defaults below, 20 + sizeof(ControlSpawnTail)
+// set everything
+struct ControlSpawnTail {
+    float minSpeed, maxSpeed;    // 2.4, 2.7
+    Vector2 velMin, velMax;      // -5..5 on both axes
+    uint32_t pathMode;           // SpawnPathMode, SPAWN_PATH_RANDOM
+    int32_t pathIndex;           // SPAWN_PATH_FIXED only
+    float clearance;             // agentRadius; < 0 spawns on top of obstacles too
+};
+#pragma pack(pop)
+
+static const size_t CONTROL_MAX_MESSAGE = 256;
+static const uint32_t CONTROL_MAX_SPAWN = 1u << 24; // agents per CTRL_SPAWN request
+
+// Parameters addressable by CTRL_SET_PARAM / CTRL_GET_PARAM, in wire order
+static float SteeringSettings::* const CONTROL_PARAMS[] = {
+    &SteeringSettings::separationRadius, &SteeringSettings::separationStrength,
+    &SteeringSettings::predictiveLookAhead, &SteeringSettings::predictiveStrength,
+    &SteeringSettings::obstacleLookAhead, &SteeringSettings::obstacleStrength,
+    &SteeringSettings::wallMargin, &SteeringSettings::wallStrength, &SteeringSettings::pathWaypointRadius,
+    &SteeringSettings::farFieldTheta, &SteeringSettings::continuumCellSize, &SteeringSettings::continuumMaxDensity,
+    &SteeringSettings::agentRadius, &SteeringSettings::pursuitSenseRadius,
+};
+static const int CONTROL_PARAM_COUNT = (int)(sizeof(CONTROL_PARAMS) / sizeof(CONTROL_PARAMS[0]));
+
+// The sim state the control socket is allowed to touch
+struct ControlTargets {
+    SteeringSettings* settings = nullptr;
+    bool* singleAgentMode = nullptr;
+    bool* drawDebug = nullptr;
+    std::vector<Agent>* agents = nullptr;
+    const std::vector<Vector2>* path = nullptr;
+    const std::vector<Vector2>* obsCenters = nullptr;
+    const std::vector<float>* obsRadii = nullptr;
+    float worldW = 0, worldH = 0;
+    uint32_t seed = 0; // the run seed; spawns draw from it, offset by the step they happen on
+    const uint64_t* step = nullptr;
+    bool paused = false;
+    uint64_t pendingSteps = 0;
+    bool quit = false;
+    float lastStepMs = 0, avgStepMs = 0;
+    const QuarantineStats* quarantine = nullptr;
+    const BehaviorCounters* behavior = nullptr;
+    const LoadShedder* shedder = nullptr;
+    const EventStream* events = nullptr;
+    std::vector<uint8_t>* journal = nullptr; // when set, successful state-changing requests are appended (header + payload)
+};
+
+struct ControlServer {
+    struct Client {
+        ControlSocket socket;
+        std::vector<uint8_t> in, out;
+    };
+    ControlSocket listener = CONTROL_INVALID_SOCKET;
+    std::string path;
+    std::vector<Client> clients;
+};
+
+static bool SetNonBlocking(ControlSocket s) {
+#if defined(_WIN32)
+    u_long on = 1;
+    return ioctlsocket(s, FIONBIO, &on) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool StartControlServer(ControlServer& server, const char* socketPath) {
+#if defined(_WIN32)
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+#endif
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, socketPath);
+    remove(socketPath); // stale socket from a previous run
+    server.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listener == CONTROL_INVALID_SOCKET) return false;
+    if (bind(server.listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(server.listener, 8) != 0 || !SetNonBlocking(server.listener)) {
+        CloseControlSocket(server.listener);
+        server.listener = CONTROL_INVALID_SOCKET;
+        return false;
+    }
+    server.path = socketPath;
+    return true;
+}
+
+void StopControlServer(ControlServer& server) {
+    if (server.listener == CONTROL_INVALID_SOCKET) return;
+    for (ControlServer::Client& c : server.clients) CloseControlSocket(c.socket);
+    server.clients.clear();
+    CloseControlSocket(server.listener);
+    server.listener = CONTROL_INVALID_SOCKET;
+    remove(server.path.c_str());
+#if defined(_WIN32)
+    WSACleanup();
+#endif
+}
+
+static void ControlReply(std::vector<uint8_t>& out, const ControlHeader& req, uint8_t status, const void* payload = nullptr, size_t bytes = 0) {
+    ControlHeader h = req;
+    h.size = (uint16_t)(sizeof(ControlHeader) + bytes);
+    h.status = status;
+    const uint8_t* p = (const uint8_t*)&h;
+    out.insert(out.end(), p, p + sizeof(h));
+    if (bytes) out.insert(out.end(), (const uint8_t*)payload, (const uint8_t*)payload + bytes);
+}
+
+static void ControlJournal(ControlTargets& t, const ControlHeader& h, const uint8_t* payload, size_t bytes) {
+    if (!t.journal) return;
+    const uint8_t* p = (const uint8_t*)&h;
+    t.journal->insert(t.journal->end(), p, p + sizeof(h));
+    t.journal->insert(t.journal->end(), payload, payload + bytes);
+}
+
+static bool* ControlToggleFlag(ControlTargets& t, uint8_t toggle) {
+    switch (toggle) {
+    case CTRL_TOGGLE_PATH: return &t.settings->enablePathFollowing;
+    case CTRL_TOGGLE_SEPARATION: return &t.settings->enableSeparation;
+    case CTRL_TOGGLE_PREDICTIVE: return &t.settings->enablePredictiveAvoid;
+    case CTRL_TOGGLE_OBSTACLE: return &t.settings->enableObstacleAvoid;
+    case CTRL_TOGGLE_WALL: return &t.settings->enableWallAvoid;
+    case CTRL_TOGGLE_PRIORITY: return &t.settings->usePriority;
+    case CTRL_TOGGLE_SINGLE_AGENT: return t.singleAgentMode;
+    case CTRL_TOGGLE_DRAW_DEBUG: return t.drawDebug;
+    case CTRL_TOGGLE_FAR_FIELD: return &t.settings->farFieldSeparation;
+    case CTRL_TOGGLE_CONTINUUM: return &t.settings->continuumMode;
+    case CTRL_TOGGLE_CONTACTS: return &t.settings->enableContacts;
+    case CTRL_TOGGLE_TOROIDAL: return &t.settings->toroidalWorld;
+    case CTRL_TOGGLE_PURSUIT: return &t.settings->enablePursuit;
+    }
+    return nullptr;
+}
+
+static void ExecuteControl(ControlTargets& t, const ControlHeader& h, const uint8_t* payload, size_t bytes, std::vector<uint8_t>& out) {
+    switch (h.op) {
+    case CTRL_PAUSE:
+        if (bytes != 1) break;
+        t.paused = payload[0] != 0;
+        ControlReply(out, h, CTRL_OK);
+        return;
+    case CTRL_STEP: {
+        if (bytes != 4) break;
+        uint32_t n;
+        memcpy(&n, payload, 4);
+        t.pendingSteps += n;
+        ControlReply(out, h, CTRL_OK);
+        return;
+    }
+    case CTRL_SET_TOGGLE: {
+        bool* flag = bytes == 2 ? ControlToggleFlag(t, payload[0]) : nullptr;
+        if (!flag) break;
+        bool was = *flag;
+        *flag = payload[1] != 0;
+        if (payload[0] == CTRL_TOGGLE_FAR_FIELD && *flag && !was) LogFarFieldReport(*t.agents, *t.settings); // as the F key does
+        ControlJournal(t, h, payload, bytes);
+        ControlReply(out, h, CTRL_OK);
+        return;
+    }
+    case CTRL_GET_TOGGLES: {
+        uint32_t bits = 0;
+        for (uint8_t i = 0; i < CTRL_TOGGLE_COUNT; ++i)
+            if (*ControlToggleFlag(t, i)) bits |= 1u << i;
+        ControlReply(out, h, CTRL_OK, &bits, sizeof(bits));
+        return;
+    }
+    case CTRL_SET_PARAM: {
+        float v;
+        if (bytes != 5 || payload[0] >= CONTROL_PARAM_COUNT) break;
+        memcpy(&v, payload + 1, 4);
+        if (!(v >= 0)) break; // also rejects NaN
+        t.settings->*CONTROL_PARAMS[payload[0]] = v;
+        ControlJournal(t, h, payload, bytes);
+        ControlReply(out, h, CTRL_OK);
+        return;
+    }
+    case CTRL_GET_PARAM: {
+        if (bytes != 1 || payload[0] >= CONTROL_PARAM_COUNT) break;
+        float v = t.settings->*CONTROL_PARAMS[payload[0]];
+        ControlReply(out, h, CTRL_OK, &v, sizeof(v));
+        return;
+    }
+    case CTRL_SPAWN: {
+        if (bytes != 20 && bytes != 20 + sizeof(ControlSpawnTail)) break;
+        ScenarioSpawn s;
+        float r[4];
+        memcpy(&s.count, payload, 4);
+        if (s.count > CONTROL_MAX_SPAWN) break;
+        memcpy(r, payload + 4, 16);
+        s.min = { r[0], r[1] };
+        s.max = { r[2], r[3] };
+        s.minSpeed = 2.4f;
+        s.maxSpeed = 2.7f;
+        s.clearance = t.settings->agentRadius;
+        if (bytes > 20) {
+            ControlSpawnTail tail;
+            memcpy(&tail, payload + 20, sizeof(tail));
+            if (tail.pathMode > SPAWN_PATH_NEAREST || tail.pathIndex < 0 || !(tail.minSpeed >= 0 && tail.maxSpeed >= tail.minSpeed)
+                || tail.clearance != tail.clearance) break; // NaN clearance
+            s.minSpeed = tail.minSpeed;
+            s.maxSpeed = tail.maxSpeed;
+            s.velMin = tail.velMin;
+            s.velMax = tail.velMax;
+            s.pathMode = (SpawnPathMode)tail.pathMode;
+            s.pathIndex = tail.pathIndex;
+            s.clearance = tail.clearance;
+        }
+        std::vector<Agent>& agents = *t.agents;
+        size_t first = agents.size();
+        agents.resize(first + s.count);
+        SpawnAgentsClear(agents.data() + first, first, s, (*t.step << 32) | t.seed, *t.path, *t.obsCenters, *t.obsRadii, t.worldW, t.worldH);
+        uint32_t count = (uint32_t)agents.size();
+        ControlJournal(t, h, payload, bytes);
+        ControlReply(out, h, CTRL_OK, &count, sizeof(count));
+        return;
+    }
+    case CTRL_STATS: {
+        ControlStats st = ControlStats();
+        st.step = *t.step;
+        st.agentCount = (uint32_t)t.agents->size();
+        st.paused = t.paused ? 1 : 0;
+        st.lastStepMs = t.lastStepMs;
+        st.avgStepMs = t.avgStepMs;
+        st.quarantined = t.quarantine ? t.quarantine->total : 0;
+        if (t.behavior) st.behavior = *t.behavior;
+        st.loadLevel = t.shedder ? (uint32_t)t.shedder->level : 0;
+        ControlReply(out, h, CTRL_OK, &st, sizeof(st));
+        return;
+    }
+    case CTRL_QUIT:
+        t.quit = true;
+        ControlReply(out, h, CTRL_OK);
+        return;
+    case CTRL_EVENTS: {
+        if (bytes != 5 || payload[0] >= EVENT_TYPE_COUNT || !t.events) break;
+        uint32_t first;
+        memcpy(&first, payload + 1, 4);
+        EventRange r = EventsOfType(*t.events, (SimEventType)payload[0]);
+        uint32_t total = (uint32_t)r.size();
+        size_t room = (0xFFFF - sizeof(ControlHeader) - 12) / sizeof(SimEvent);
+        size_t n = first < total ? std::min<size_t>(total - first, room) : 0;
+        std::vector<uint8_t> reply(12 + n * sizeof(SimEvent));
+        memcpy(&reply[0], &t.events->step, 8);
+        memcpy(&reply[8], &total, 4);
+        if (n) memcpy(&reply[12], r.first + first, n * sizeof(SimEvent));
+        ControlReply(out, h, CTRL_OK, reply.data(), reply.size());
+        return;
+    }
+    default:
+        ControlReply(out, h, CTRL_UNKNOWN_OP);
+        return;
+    }
+    ControlReply(out, h, CTRL_BAD_REQUEST);
+}
+
+// Runs the journaled requests of a logged step (FrameInput::control) again; the replies are discarded
+void ReplayControl(ControlTargets& t, const std::vector<uint8_t>& journal) {
+    std::vector<uint8_t> out;
+    size_t pos = 0;
+    while (journal.size() - pos >= sizeof(ControlHeader)) {
+        ControlHeader h;
+        memcpy(&h, &journal[pos], sizeof(h));
+        if (h.size < sizeof(ControlHeader) || h.size > journal.size() - pos) break;
+        ExecuteControl(t, h, &journal[pos + sizeof(h)], h.size - sizeof(h), out);
+        pos += h.size;
+    }
+}
+
+// Accepts new clients, runs every complete request that has arrived and flushes the replies; never blocks
+void ServiceControl(ControlServer& server, ControlTargets& t) {
+    if (server.listener == CONTROL_INVALID_SOCKET) return;
+    for (;;) {
+        ControlSocket c = accept(server.listener, nullptr, nullptr);
+        if (c == CONTROL_INVALID_SOCKET) break;
+        if (!SetNonBlocking(c)) { CloseControlSocket(c); continue; }
+        server.clients.push_back({ c, {}, {} });
+    }
+    uint8_t buf[16384];
+    for (size_t ci = 0; ci < server.clients.size();) {
+        ControlServer::Client& c = server.clients[ci];
+        bool alive = true;
+        for (;;) {
+            int n = (int)recv(c.socket, (char*)buf, sizeof(buf), 0);
+            if (n > 0) { c.in.insert(c.in.end(), buf, buf + n); continue; }
+            if (n == 0) alive = false; // peer closed
+#if defined(_WIN32)
+            else if (WSAGetLastError() != WSAEWOULDBLOCK) alive = false;
+#else
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) alive = false;
+#endif
+            break;
+        }
+        size_t pos = 0;
+        while (alive && c.in.size() - pos >= sizeof(ControlHeader)) {
+            ControlHeader h;
+            memcpy(&h, &c.in[pos], sizeof(h));
+            if (h.size < sizeof(ControlHeader) || h.size > CONTROL_MAX_MESSAGE) { alive = false; break; } // lost framing
+            if (c.in.size() - pos < h.size) break;
+            ExecuteControl(t, h, &c.in[pos + sizeof(h)], h.size - sizeof(h), c.out);
+            pos += h.size;
+        }
+        c.in.erase(c.in.begin(), c.in.begin() + pos);
+        while (alive && !c.out.empty()) {
+            int n = (int)send(c.socket, (const char*)c.out.data(), (int)std::min<size_t>(c.out.size(), 1 << 20), CONTROL_SEND_FLAGS);
+            if (n <= 0) break; // socket buffer full, retry next service
+            c.out.erase(c.out.begin(), c.out.begin() + n);
+        }
+        if (!alive) {
+            CloseControlSocket(c.socket);
+            server.clients.erase(server.clients.begin() + ci);
+        }
+        else ++ci;
+    }
+}
+
+// ---------- Drawing helpers ----------
+void DrawAgentTriangle(const Vector2& pos, const Vector2& vel, Color color) {
+    // Robust triangle draw:
+    // - If velocity is near zero, pick a default heading (right)
+    // - Larger triangle (so it's visible on big screens)
+    // - Draw filled triangle + outline
+
+    float heading;
+    if (Length(vel) < 0.01f) {
+        // default facing right (so it is visible even if agent is stationary)
+        heading = 0.0f;
+    }
+    else {
+        heading = atan2f(vel.y, vel.x);
+    }
+
+    // triangle size
+    float forward = 20.0f;      // length from center to tip
+    float halfBase = 12.0f;     // half of base width
+
+    // define local points (pointing toward +X)
+    Vector2 p1 = { forward, 0 };                 // tip
+    Vector2 p2 = { -halfBase, halfBase * 0.7f }; // bottom-left
+    Vector2 p3 = { -halfBase, -halfBase * 0.7f };// top-left
+
+    // rotation matrix
+    float s = sinf(heading), c = cosf(heading);
+    auto rot = [&](const Vector2& p) {
+        return Vector2{ pos.x + (p.x * c - p.y * s), pos.y + (p.x * s + p.y * c) };
+        };
+
+    Vector2 r1 = rot(p1), r2 = rot(p2), r3 = rot(p3);
+
+    // Draw filled + outline for better visibility
+    DrawTriangle(r1, r2, r3, color);
+    DrawTriangleLines(r1, r2, r3, BLACK);
+}
+
+// ---------- Main ----------
+int main(int argc, char** argv) {
+    const int screenW = 1800, screenH = 1000;
+    EnableFlushDenormals();
+    ProfilerRegisterThread();
+
+    // --record-input <file>   log per-step input of this session
+    // --record-replay <file>  record agent state every step (see Replay recording), verified by reading it back on exit
+    // --replay-input <file>   run a logged session headless (no window) and report step timings
+    // --seed <n>              fixed RNG seed (a replay always uses the seed stored in its log)
+    // --scenario <file>       world description to load instead of scenario.txt (see LoadScenario)
+    // --state-feed <name>     publish agent state to shared memory for external viewers
+    // --domains <n>           headless run split over n processes by vertical strips (with --steps)
+    // --steps <n>             steps for --domains runs
+    // --control <path>        serve the control socket (see ControlOp) at path
+    // --headless              no window; with --control the harness drives pause/step
+    // --profile <hz>          sample call stacks at hz (see Sampling profiler); top functions in the debug overlay,
+    //                         or logged on exit when headless
+    // --budget <ms>           step time above which steering quality is shed (see Load shedding); off by default
+    const char* recordInputFile = nullptr;
+    const char* replayFile = nullptr;
+    const char* stateFeedName = nullptr;
+    uint32_t domainCount = 0;
+    uint64_t domainSteps = 1000;
+    const char* domainShm = nullptr; // internal: set for spawned domain processes
+    int domainWorker = -1;
+    const char* controlPath = nullptr;
+    bool noWindow = false;
+    const char* replayInputFile = nullptr;
+    int profileHz = 0;
+    float budgetMs = LoadShedder().budgetMs;
+    uint32_t seed = (uint32_t)time(nullptr);
+    const char* scenarioFile = "scenario.txt"; // when present, replaces the built-in path/obstacles/agents
+    for (int i = 1; i < argc; ++i) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(argv[i], "--headless") == 0) { noWindow = true; continue; }
+        if (!value) { TraceLog(LOG_WARNING, "Missing value for %s", argv[i]); break; }
+        if (strcmp(argv[i], "--record-input") == 0) recordInputFile = value;
+        else if (strcmp(argv[i], "--replay-input") == 0) replayInputFile = value;
+        else if (strcmp(argv[i], "--record-replay") == 0) replayFile = value;
+        else if (strcmp(argv[i], "--state-feed") == 0) stateFeedName = value;
+        else if (strcmp(argv[i], "--domains") == 0) domainCount = (uint32_t)strtoul(value, nullptr, 10);
+        else if (strcmp(argv[i], "--steps") == 0) domainSteps = strtoull(value, nullptr, 10);
+        else if (strcmp(argv[i], "--domain-shm") == 0) domainShm = value;
+        else if (strcmp(argv[i], "--domain-worker") == 0) domainWorker = atoi(value);
+        else if (strcmp(argv[i], "--control") == 0) controlPath = value;
+        else if (strcmp(argv[i], "--seed") == 0) seed = (uint32_t)strtoul(value, nullptr, 10);
+        else if (strcmp(argv[i], "--scenario") == 0) scenarioFile = value;
+        else if (strcmp(argv[i], "--profile") == 0) profileHz = atoi(value);
+        else if (strcmp(argv[i], "--budget") == 0) budgetMs = (float)atof(value);
+        else TraceLog(LOG_WARNING, "Unknown argument %s", argv[i]);
+        ++i;
+    }
+    InputReplay inputReplay;
+    const bool domainMode = domainCount > 0 || (domainShm && domainWorker >= 0);
+    const bool headless = replayInputFile != nullptr || domainMode || noWindow;
+    if (replayInputFile) {
+        if (!OpenInputReplay(inputReplay, replayInputFile)) {
+            TraceLog(LOG_ERROR, "Could not read input log %s", replayInputFile);
+            return 1;
+        }
+        seed = inputReplay.header.seed;
+    }
+    else if (!headless) {
+        InitWindow(screenW, screenH, "Steering Behaviors Assignment - Fixed");
+        SetTargetFPS(60);
+    }
+    SetRandomSeed(seed);
+    if (profileHz > 0 && !StartProfiler(profileHz)) TraceLog(LOG_WARNING, "Could not start the sampling profiler");
+
+    // --- Task1 single-agent setup ---
+    Agent player;
+    player.pos = { 500,400 };
+    // *** small non-zero initial velocity so heading is defined immediately ***
+    player.vel = { 0.05f, 0.0f };
+    player.acc = { 0,0 };
+    player.maxSpeed = 3.0f;
+    player.maxForce = 0.12f;
+    float wanderAngle = 0.0f;
+    uint64_t singleStep = 0; // single-agent steps taken, counter for the player's Wander draws
+    Vector2 target = { 700,500 };
+    int singleMode = 1; // 1=Seek 2=Flee 3=Pursue 4=Evade 5=Arrive 6=Wander
+    Vector2 mousePrev = headless ? inputReplay.header.initialMouse : GetMousePosition();
+    Vector2 mouseVel = { 0,0 };
+
+    // --- Task2 multi-agent setup ---
+    std::vector<Vector2> path = {
+        {150,120}, {400,90}, {800,150}, {920,300},
+        {800,520}, {520,620}, {240,500}, {100,350}
+    };
+    std::vector<Vector2> obsCenters = { {500,320}, {300,380}, {700,460} };
+    std::vector<float> obsRadii = { 60.0f, 45.0f, 55.0f };
+
+    std::vector<Agent> agents;
+    const int AGENT_COUNT = 12;
+
+    // the scenario file, when present, replaces the built-in path/obstacles/agents below
+    Scenario scenario;
+    std::string scenarioError;
+    bool scenarioLoaded = LoadScenario(scenarioFile, scenario, &scenarioError, SteeringSettings().agentRadius);
+    if (scenarioLoaded) {
+        path.swap(scenario.path);
+        obsCenters.swap(scenario.obsCenters);
+        obsRadii.swap(scenario.obsRadii);
+        agents.swap(scenario.agents);
+        TraceLog(LOG_INFO, "Scenario %s: %d agents, %d waypoints, %d obstacles loaded in %.1f ms", scenarioFile,
+            (int)agents.size(), (int)path.size(), (int)obsCenters.size(), scenario.loadMs);
+    }
+    else {
+        TraceLog(LOG_INFO, "Scenario: %s, using the built-in world", scenarioError.c_str());
+    }
+    if (!scenarioLoaded) {
+        ScenarioSpawn spawn = { AGENT_COUNT, { 80.0f, 80.0f }, { screenW - 80.0f, screenH - 80.0f }, 2.4f, 2.7f };
+        spawn.clearance = SteeringSettings().agentRadius;
+        agents.resize(AGENT_COUNT);
+        SpawnAgentsClear(agents.data(), 0, spawn, seed, path, obsCenters, obsRadii, (float)screenW, (float)screenH);
+    }
+
+    // Toggles & weights
+    bool singleAgentMode = true; // if true show Task1 single-agent, else multi-agent Task2
+    SteeringSettings settings; // multi-agent toggles & weights
+    NeighborGrid grid; // rebuilt by every StepAgents, also serves the spatial queries
+    NeighborGrid farFieldGrid; // F: finer cells and the mass pyramid for far-field separation
+    ContinuumField continuum; // C switches the multi-agent step to the continuum crowd
+    ObstacleSchedule obstacleSchedule; // limits ObstacleAvoidance to agents that can reach an obstacle
+    ObstacleBitmap occupancy; // ... and skips it for agents in obstacle-free cells
+    GridTuner gridTuner; // online cell size for StepAgents' grid
+    LoadShedder shedder; // trades steering quality for step time under overload
+    PursuitTeams pursuit; // H: predator/prey teams and their cached targets
+    EventStream events; // waypoints, near collisions and wall hits of the last step
+    shedder.budgetMs = budgetMs;
+    BehaviorCounters behaviorCounts; // of the last step
+    QuarantineStats quarantine; // NaN/Inf agents reset after each step
+    ContactSolver contacts; // N toggles the non-penetration pass
+    EcsWorld wanderers; // W spawns ambient agents on the experimental ECS at the mouse (multi-agent mode)
+    bool drawDebug = true;
+
+    // --- NEW: single-agent combining toggle (Task3 demonstration) ---
+    bool singleCombine = false; // press 'B' to toggle combining for single agent
+
+    uint64_t simStep = 0; // multi-agent steps taken, stored in snapshots
+    const char* snapshotFile = "world.snap";
+
+    if (domainShm && domainWorker >= 0)
+        return RunDomainWorker(domainShm, (uint32_t)domainWorker, path, obsCenters, obsRadii, settings);
+    if (domainCount > 0)
+        return RunDomains(argv[0], domainCount, domainSteps, agents, path, obsCenters, obsRadii, settings, (float)screenW, (float)screenH,
+            seed, scenarioFile);
+
+    uint64_t worldHash = HashWorld(agents, path, obsCenters, obsRadii);
+    InputRecorder inputRecorder;
+    if (replayInputFile && worldHash != inputReplay.header.worldHash)
+        TraceLog(LOG_WARNING, "Input log %s was recorded against a different world, replay will diverge", replayInputFile);
+    if (recordInputFile && !StartInputRecording(inputRecorder, recordInputFile, seed, worldHash, mousePrev))
+        TraceLog(LOG_WARNING, "Could not open %s for input recording", recordInputFile);
+
+    StateFeedWriter stateFeed;
+    if (stateFeedName) {
+        size_t capacity = std::min<size_t>(std::max<size_t>(agents.size() * 2, 4096), 0x7FFFFFFF);
+        if (!StateFeedCreate(stateFeed, stateFeedName, (uint32_t)capacity))
+            TraceLog(LOG_WARNING, "Could not create state feed %s", stateFeedName);
+    }
+
+    // --record-replay: post-mortem recording; encoding happens off the sim thread
+    ReplayRecorder replay;
+    if (replayFile && !StartReplayRecording(replay, replayFile)) TraceLog(LOG_WARNING, "Could not open %s for recording", replayFile);
+    auto finishReplay = [&]() {
+        if (!replayFile) return;
+        if (!StopReplayRecording(replay)) TraceLog(LOG_WARNING, "Replay %s: a write failed, the file is incomplete", replayFile);
+        else if (!VerifyReplay(replay, replayFile)) TraceLog(LOG_WARNING, "Replay %s: reading it back does not match the recorded state", replayFile);
+        else TraceLog(LOG_INFO, "Replay %s: %llu bytes, read back ok", replayFile, (unsigned long long)replay.bytesWritten);
+    };
+
+    // per-step steering breakdown for offline analysis, F6 starts/stops
+    TrajectoryExporter trajectory;
+    const char* trajectoryFile = "trajectory.col";
+    auto finishTrajectory = [&]() {
+        if (!trajectory.file) return;
+        if (!StopTrajectoryExport(trajectory)) TraceLog(LOG_WARNING, "Trajectory export %s: a write failed, the file is incomplete", trajectoryFile);
+        else TraceLog(LOG_INFO, "Trajectory export stopped: %s", trajectoryFile);
+    };
+
+    // One simulation step driven only by `in`, shared by the interactive loop and headless replay
+    auto stepSimulation = [&](const FrameInput& in) {
+        if (in.gridScale > 0) gridTuner.scale = in.gridScale;
+        if (in.loadLevel >= 0 && in.loadLevel < LOAD_LEVEL_COUNT && in.loadLevel != shedder.level) {
+            TraceLog(in.loadLevel > shedder.level ? LOG_WARNING : LOG_INFO, "Load level %d -> %d (%s), step %.1f ms against a %.1f ms budget",
+                shedder.level, in.loadLevel, LOAD_LEVEL_NAMES[in.loadLevel], shedder.avgMs, shedder.budgetMs);
+            shedder.level = in.loadLevel;
+        }
+        // headless control runs have no mouse (in.mouse stays at the origin), so keep the middle of the world sharp
+        shedder.focus = headless && !replayInputFile ? Vector2{ screenW * 0.5f, screenH * 0.5f } : in.mouse;
+        // Input toggles
+        if (in.Pressed(KEY_TAB)) singleAgentMode = !singleAgentMode;
+        if (in.Pressed(KEY_ONE)) {
+            if (singleAgentMode) singleMode = 1; else settings.enablePathFollowing = !settings.enablePathFollowing;
+        }
+        if (in.Pressed(KEY_TWO)) {
+            if (singleAgentMode) singleMode = 2; else settings.enableSeparation = !settings.enableSeparation;
+        }
+        if (in.Pressed(KEY_THREE)) {
+            if (singleAgentMode) singleMode = 3; else settings.enablePredictiveAvoid = !settings.enablePredictiveAvoid;
+        }
+        if (in.Pressed(KEY_FOUR)) {
+            if (singleAgentMode) singleMode = 4; else settings.enableObstacleAvoid = !settings.enableObstacleAvoid;
+        }
+        if (in.Pressed(KEY_FIVE)) {
+            if (singleAgentMode) singleMode = 5; else settings.enableWallAvoid = !settings.enableWallAvoid;
+        }
+        if (in.Pressed(KEY_SIX)) {
+            if (singleAgentMode) singleMode = 6;
+        }
+        if (in.Pressed(KEY_D)) drawDebug = !drawDebug;
+        if (in.Pressed(KEY_P)) settings.usePriority = !settings.usePriority; // switch combining approach
+        if (in.Pressed(KEY_B)) singleCombine = !singleCombine; // NEW: toggle single-agent combining demo
+        if (in.Pressed(KEY_F) && !singleAgentMode) {
+            settings.farFieldSeparation = !settings.farFieldSeparation;
+            if (settings.farFieldSeparation) LogFarFieldReport(agents, settings);
+        }
+        if (in.Pressed(KEY_C) && !singleAgentMode) settings.continuumMode = !settings.continuumMode;
+        if (in.Pressed(KEY_N) && !singleAgentMode) settings.enableContacts = !settings.enableContacts;
+        if (in.Pressed(KEY_T) && !singleAgentMode) settings.toroidalWorld = !settings.toroidalWorld;
+        if (in.Pressed(KEY_H) && !singleAgentMode) settings.enablePursuit = !settings.enablePursuit;
+        if (in.Pressed(KEY_W) && !singleAgentMode) SpawnEcsWanderers(wanderers, 100, in.mouse, seed, simStep);
+        if (in.Pressed(KEY_F5)) {
+            double t0 = NowSeconds();
+            SnapshotRunState run = {};
+            run.player = player;
+            run.wanderAngle = wanderAngle;
+            run.singleStep = singleStep;
+            bool ok = SaveSnapshot(snapshotFile, simStep, agents, path, obsCenters, obsRadii, run, pursuit.team, pursuit.target);
+            TraceLog(ok ? LOG_INFO : LOG_WARNING, "Snapshot save %s: %s (%.2f ms)", snapshotFile, ok ? "ok" : "FAILED", (NowSeconds() - t0) * 1000.0);
+        }
+        if (in.Pressed(KEY_F6)) {
+            if (trajectory.file) finishTrajectory();
+            else if (!StartTrajectoryExport(trajectory, trajectoryFile)) {
+                TraceLog(LOG_WARNING, "Could not open %s for export", trajectoryFile);
+            }
+        }
+        if (in.Pressed(KEY_F9)) {
+            double t0 = NowSeconds();
+            SnapshotRunState run;
+            bool ok = LoadSnapshot(snapshotFile, simStep, agents, path, obsCenters, obsRadii, run, pursuit.team, pursuit.target);
+            if (ok) {
+                player = run.player;
+                wanderAngle = run.wanderAngle;
+                singleStep = run.singleStep;
+                wanderers = EcsWorld(); // not part of snapshots (see World snapshots)
+            }
+            InvalidateObstacleSchedule(obstacleSchedule);
+            shedder.predictCache.clear(); // cached steering belongs to the agents before the load
+            shedder.steerCache.clear();
+            TraceLog(ok ? LOG_INFO : LOG_WARNING, "Snapshot load %s: %s (%.2f ms, %d agents)", snapshotFile, ok ? "ok" : "FAILED", (NowSeconds() - t0) * 1000.0, (int)agents.size());
+        }
+
+        // Mouse target & mouse velocity estimation for pursue/evade
+        target = in.mouse;
+        Vector2 mNow = target;
+        mouseVel = Sub(mNow, mousePrev);
+        mousePrev = mNow;
+
+        // ---------- Single-agent behavior (Task1) ----------
+        if (singleAgentMode) {
+            singleStep++;
+            Vector2 steering = { 0,0 };
+
+            // Optionally demonstrate combining (Task3) for single agent:
+            if (singleCombine) {
+                // Weighted blend of Wander (exploration) + Seek (goal-directed)
+                Vector2 wanderF = Wander(player.pos, player.vel, player.maxSpeed, wanderAngle, AgentRandom(seed, PLAYER_AGENT_ID, singleStep).v[0]);
+                Vector2 seekF = Seek(player.pos, target, player.maxSpeed);
+                std::vector<std::pair<Vector2, float>> wforces;
+                wforces.push_back({ wanderF, 0.6f }); // wander 60%
+                wforces.push_back({ seekF,   1.0f }); // seek stronger
+                steering = WeightedBlend(wforces, player.maxForce * 2.0f); // produce desired velocity-ish
+            }
+            else {
+                switch (singleMode) {
+                case 1: steering = Seek(player.pos, target, player.maxSpeed); break;
+                case 2: steering = Flee(player.pos, target, player.maxSpeed); break;
+                case 3: steering = Pursue(player.pos, target, mouseVel, player.maxSpeed, 0.8f); break;
+                case 4: steering = Evade(player.pos, target, mouseVel, player.maxSpeed, 0.8f); break;
+                case 5: steering = Arrive(player.pos, target, player.maxSpeed, 140.0f); break;
+                case 6: steering = Wander(player.pos, player.vel, player.maxSpeed, wanderAngle, AgentRandom(seed, PLAYER_AGENT_ID, singleStep).v[0]); break;
+                }
+            }
+
+            // steering returned is desired velocity (for Seek/Flee/Arrive/Wander). Convert to steering = desired - vel
+            Vector2 steerVec = Sub(steering, player.vel);
+            steerVec = Limit(steerVec, player.maxForce);
+
+            // integrate (no explicit dt scaling here  frame-rate stable enough for demo)
+            player.vel = Add(player.vel, steerVec);
+            player.vel = Limit(player.vel, player.maxSpeed);
+            player.pos = Add(player.pos, player.vel);
+
+            // keep inside screen
+            if (player.pos.x < 0) player.pos.x = 0;
+            if (player.pos.y < 0) player.pos.y = 0;
+            if (player.pos.x > screenW) player.pos.x = screenW;
+            if (player.pos.y > screenH) player.pos.y = screenH;
+            if (!AgentFinite(player)) {
+                ResetAgent(player, {}, { 500,400 });
+                quarantine.total++;
+            }
+        }
+        // ---------- Multi-agent behaviors (Task2) ----------
+        else {
+            simStep++;
+            behaviorCounts = BehaviorCounters();
+            BeginEvents(events, simStep);
+            if (settings.continuumMode) StepContinuum(agents, continuum, grid, &occupancy, &behaviorCounts, &events, path, obsCenters, obsRadii, settings, (float)screenW, (float)screenH, simStep, &trajectory);
+            else StepAgents(agents, agents.size(), grid, &farFieldGrid, &obstacleSchedule, &occupancy, &gridTuner, &behaviorCounts, &shedder, &pursuit, &events, path, obsCenters, obsRadii, settings, (float)screenW, (float)screenH, simStep, &trajectory);
+            if (settings.enableContacts) SolveContacts(contacts, agents, agents.size(), grid, obsCenters, obsRadii, settings, (float)screenW, (float)screenH);
+            EmitNearCollisions(&events, agents, agents.size(), grid, settings.agentRadius);
+            MergeEvents(events);
+            QuarantineAgents(agents, agents.size(), path, { screenW * 0.5f, screenH * 0.5f }, quarantine);
+            StepEcsWanderers(wanderers, path, agents, grid, settings.pathWaypointRadius, (float)screenW, (float)screenH, seed, simStep);
+            RecordReplayFrame(replay, simStep, agents);
+            PublishStateFeed(stateFeed, simStep, agents);
+        }
+    };
+
+    // what the control socket may touch; --replay-input runs the logged control requests through it too
+    ControlTargets controlTargets;
+    controlTargets.settings = &settings;
+    controlTargets.singleAgentMode = &singleAgentMode;
+    controlTargets.drawDebug = &drawDebug;
+    controlTargets.agents = &agents;
+    controlTargets.path = &path;
+    controlTargets.obsCenters = &obsCenters;
+    controlTargets.obsRadii = &obsRadii;
+    controlTargets.worldW = (float)screenW;
+    controlTargets.worldH = (float)screenH;
+    controlTargets.seed = seed;
+    controlTargets.step = &simStep;
+    controlTargets.quarantine = &quarantine;
+    controlTargets.behavior = &behaviorCounts;
+    controlTargets.shedder = &shedder;
+    controlTargets.events = &events;
+    std::vector<uint8_t> controlJournal; // requests since the last recorded step
+    if (recordInputFile) controlTargets.journal = &controlJournal;
+
+    if (replayInputFile) {
+        std::vector<double> stepMs;
+        FrameInput in;
+        double t0 = NowSeconds();
+        while (NextInput(inputReplay, in)) {
+            ReplayControl(controlTargets, in.control);
+            double s0 = NowSeconds();
+            stepSimulation(in);
+            stepMs.push_back((NowSeconds() - s0) * 1000.0);
+            DrainProfiler();
+        }
+        double totalMs = (NowSeconds() - t0) * 1000.0;
+        std::sort(stepMs.begin(), stepMs.end());
+        if (!stepMs.empty()) {
+            TraceLog(LOG_INFO, "Replay %s: %d steps, %d agents, total %.1f ms, median %.3f ms, p99 %.3f ms, max %.3f ms",
+                replayInputFile, (int)stepMs.size(), (int)agents.size(), totalMs, stepMs[stepMs.size() / 2],
+                stepMs[stepMs.size() * 99 / 100], stepMs.back());
+        }
+        StopProfiler();
+        LogProfile();
+        finishReplay();
+        finishTrajectory();
+        StateFeedDestroy(stateFeed);
+        return 0;
+    }
+
+    ControlServer control;
+    if (controlPath && !StartControlServer(control, controlPath))
+        TraceLog(LOG_WARNING, "Could not open control socket %s", controlPath);
+    // runs one step unless the harness paused us; returns false once nothing is left to run. Fills in the grid
+    // tuner's and the load shedder's decisions so a recorded `in` replays them.
+    auto controlledStep = [&](FrameInput& in) {
+        ServiceControl(control, controlTargets);
+        DrainProfiler(); // outside the timed step: symbol lookups are not step time the shedder should react to
+        if (controlTargets.paused) {
+            if (controlTargets.pendingSteps == 0) return false;
+            controlTargets.pendingSteps--;
+        }
+        in.gridScale = GridTunerPropose(gridTuner);
+        in.loadLevel = (int8_t)LoadShedderPropose(shedder);
+        in.control.swap(controlJournal); // requests served while paused go with the next step that runs
+        controlJournal.clear();
+        double s0 = NowSeconds();
+        stepSimulation(in);
+        controlTargets.lastStepMs = (float)((NowSeconds() - s0) * 1000.0);
+        LoadShedderSample(shedder, controlTargets.lastStepMs);
+        controlTargets.avgStepMs += (controlTargets.lastStepMs - controlTargets.avgStepMs) * 0.05f;
+        return true;
+    };
+
+    if (headless) {
+        // --headless: only useful together with --control, the harness decides when to stop
+        singleAgentMode = false;
+        while (!controlTargets.quit && control.listener != CONTROL_INVALID_SOCKET) {
+            FrameInput idle;
+            if (!controlledStep(idle)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        StopControlServer(control);
+        StopProfiler();
+        LogProfile();
+        finishReplay();
+        finishTrajectory();
+        StateFeedDestroy(stateFeed);
+        return 0;
+    }
+
+    // main loop
+    while (!WindowShouldClose() && !controlTargets.quit) {
+        FrameInput frameInput = PollFrameInput();
+        if (controlledStep(frameInput)) RecordInput(inputRecorder, frameInput);
+
+        // ---------- Drawing ----------
+        BeginDrawing();
+        const bool debugDraw = drawDebug && shedder.level < LOAD_NO_DEBUG_DRAW; // shed under overload
+        ClearBackground(WHITE);
+
+        // Draw path
+        for (size_t i = 0;i < path.size();++i) {
+            Vector2 a = path[i];
+            Vector2 b = path[(i + 1) % path.size()];
+            DrawLineEx(a, b, 2.0f, LIGHTGRAY);
+            DrawCircleV(a, 6, DARKGRAY);
+        }
+
+        // Draw obstacles
+        for (size_t i = 0;i < obsCenters.size();++i) {
+            DrawCircleV(obsCenters[i], obsRadii[i], Fade(RED, 0.22f));
+            DrawCircleLines((int)obsCenters[i].x, (int)obsCenters[i].y, obsRadii[i], RED);
+            if (debugDraw) {
+                DrawText(TextFormat("Obs %d", (int)i), (int)obsCenters[i].x - 18, (int)obsCenters[i].y - (int)obsRadii[i] - 18, 10, DARKGRAY);
+            }
+        }
+
+        // Draw either single agent (Task1) or agents (Task2)
+        if (singleAgentMode) {
+            // draw target
+            DrawCircleV(target, 7, DARKBLUE);
+
+            // draw debug circle at player pos so you can see it even if triangle color blends
+            if (debugDraw) DrawCircleLines((int)player.pos.x, (int)player.pos.y, 18, Fade(BLACK, 0.15f));
+
+            // draw player triangle
+            DrawAgentTriangle(player.pos, player.vel, ORANGE);
+
+            if (debugDraw) {
+                DrawText(TextFormat("Single-agent mode: %s %s",
                     (singleMode == 1 ? "Seek" : singleMode == 2 ? "Flee" : singleMode == 3 ? "Pursue" : singleMode == 4 ? "Evade" : singleMode == 5 ? "Arrive" : "Wander"),
                     singleCombine ? "(Combining ON - B)" : ""
                 ), 20, 20, 36, BLACK);
@@ -479,32 +5056,104 @@ int main() {
             }
         }
         else {
+            if (settings.continuumMode && debugDraw && continuum.cols > 0) {
+                for (int y = 0; y < continuum.rows; ++y)
+                    for (int x = 0; x < continuum.cols; ++x) {
+                        float d = continuum.density[(size_t)y * continuum.cols + x] / settings.continuumMaxDensity;
+                        if (d < 0.05f) continue;
+                        DrawRectangle((int)(continuum.origin.x + x * continuum.cellSize), (int)(continuum.origin.y + y * continuum.cellSize),
+                            (int)continuum.cellSize, (int)continuum.cellSize, Fade(ORANGE, std::min(d, 1.0f) * 0.5f));
+                    }
+            }
             // draw each agent
             for (const Agent& a : agents) {
-                if (drawDebug) DrawCircleLines((int)a.pos.x, (int)a.pos.y, (int)separationRadius, Fade(DARKBLUE, 0.25f));
+                if (debugDraw) DrawCircleLines((int)a.pos.x, (int)a.pos.y, (int)settings.separationRadius, Fade(DARKBLUE, 0.25f));
                 DrawAgentTriangle(a.pos, a.vel, a.color);
-                if (drawDebug) DrawLineEx(a.pos, Add(a.pos, Scale(a.vel, 18.0f)), 3.0f, DARKGRAY);
+                if (debugDraw) DrawLineEx(a.pos, Add(a.pos, Scale(a.vel, 18.0f)), 3.0f, DARKGRAY);
+            }
+            EcsEach<CPosition, CVelocity, CTint>(wanderers, [](size_t n, const EcsEntity*, CPosition* p, CVelocity* v, CTint* t) {
+                for (size_t i = 0; i < n; ++i) DrawAgentTriangle(p[i].v, v[i].v, t[i].color);
+            });
+            // debug pick: agent nearest to the mouse and its neighbours inside the separation radius
+            uint32_t picked = debugDraw ? QueryNearestAgent(grid, agents, GetMousePosition(), 80.0f) : AGENT_NONE;
+            if (picked != AGENT_NONE) {
+                const Agent& p = agents[picked];
+                uint32_t hits[64];
+                uint32_t found = QueryAgentsInRadius(grid, agents, p.pos, settings.separationRadius, hits, 64);
+                for (uint32_t k = 0; k < std::min(found, 64u); ++k)
+                    if (hits[k] != picked) DrawLineEx(p.pos, agents[hits[k]].pos, 1.0f, Fade(DARKBLUE, 0.5f));
+                DrawCircleLines((int)p.pos.x, (int)p.pos.y, 14, MAROON);
+                DrawText(TextFormat("#%u  neighbours:%u", picked, found - 1), (int)p.pos.x + 16, (int)p.pos.y - 20, 12, MAROON);
             }
             // UI text
-            DrawText(TextFormat("Multi-agent mode (Task2). Agents: %d", (int)agents.size()), 30, 30, 48, BLACK);
-            DrawText("Toggles: 1 Path  2 Separation  3 Predictive  4 ObsAvoid  5 WallAvoid  D Debug  P Priority/Weighted  TAB single/multi", 20, 64, 24, DARKGRAY);
-            DrawText(TextFormat("Path:%s  Sep:%s  Predict:%s  Obs:%s  Wall:%s  Combining:%s",
-                enablePathFollowing ? "ON" : "OFF",
-                enableSeparation ? "ON" : "OFF",
-                enablePredictiveAvoid ? "ON" : "OFF",
-                enableObstacleAvoid ? "ON" : "OFF",
-                enableWallAvoid ? "ON" : "OFF",
-
-                usePriority ? "PRIORITY" : "WEIGHTED"
+            DrawText(TextFormat("Multi-agent mode (Task2). Agents: %d  Wanderers: %d", (int)agents.size(), (int)wanderers.records.size()), 30, 30, 48, BLACK);
+            DrawText("Toggles: 1 Path  2 Separation  3 Predictive  4 ObsAvoid  5 WallAvoid  D Debug  P Priority/Weighted  TAB single/multi  N contacts  T torus  H pursuit  C continuum  F far-field  W wanderers  F5/F9 save/load  F6 export", 20, 64, 24, DARKGRAY);
+            DrawText(TextFormat("%sPath:%s  Sep:%s%s  Predict:%s  Obs:%s  Wall:%s  Pursuit:%s  Combining:%s",
+                settings.continuumMode ? "CONTINUUM  " : "",
+                settings.enablePathFollowing ? "ON" : "OFF",
+                settings.enableSeparation ? "ON" : "OFF",
+                settings.farFieldSeparation ? " (far-field)" : "",
+                settings.enablePredictiveAvoid ? "ON" : "OFF",
+                settings.enableObstacleAvoid ? "ON" : "OFF",
+                settings.toroidalWorld ? "TORUS" : settings.enableWallAvoid ? "ON" : "OFF",
+                settings.enablePursuit ? "ON" : "OFF",
+
+                settings.usePriority ? "PRIORITY" : "WEIGHTED"
             ), 10, 54, 12, DARKGRAY);
+            if (debugDraw && !settings.continuumMode)
+                DrawText(TextFormat("Obstacle checks: %u/%d agents  Quarantined: %u (%llu total)", obstacleSchedule.evaluated, (int)agents.size(),
+                    quarantine.lastStep, (unsigned long long)quarantine.total), 10, 110, 12, DARKGRAY);
+            if (debugDraw && !settings.continuumMode)
+                DrawText(TextFormat("Grid cell: %.0f px (x%.2f)  %.1f candidates/query  neighbour stage %.2f ms", grid.cellSize, gridTuner.scale,
+                    gridTuner.lastCandidatesPerQuery, gridTuner.lastMs), 10, 124, 12, DARKGRAY);
+            if (debugDraw) {
+                const BehaviorCounters& bc = behaviorCounts;
+                double perAgent = 100.0 / (double)std::max<uint64_t>(bc.agents, 1);
+                DrawText(TextFormat("Pairs: separation %llu tested, %llu in radius  predictive %llu tested, %llu non-zero  obstacle %llu calls, %llu non-zero",
+                    (unsigned long long)bc.sepTested, (unsigned long long)bc.sepAccepted, (unsigned long long)bc.predictTested,
+                    (unsigned long long)bc.predictActive, (unsigned long long)bc.obsEvaluated, (unsigned long long)bc.obsActive), 10, 138, 12, DARKGRAY);
+                DrawText(TextFormat("Active: path %.0f%%  sep %.0f%%  predict %.0f%%  obs %.0f%%  wall %.0f%%   Priority tier: danger %.0f%%  safety %.0f%%  navigation %.0f%%  none %.0f%%",
+                    bc.pathActive * perAgent, bc.sepActive * perAgent, bc.predictAgents * perAgent, bc.obsActive * perAgent, bc.wallActive * perAgent,
+                    bc.tier[TIER_DANGER] * perAgent, bc.tier[TIER_SAFETY] * perAgent, bc.tier[TIER_NAVIGATION] * perAgent, bc.tier[TIER_NONE] * perAgent),
+                    10, 152, 12, DARKGRAY);
+                DrawText(TextFormat("Events: %u waypoints  %u near collisions  %u wall hits  (%llu / %llu / %llu total)",
+                    (unsigned)EventsOfType(events, EVENT_WAYPOINT_REACHED).size(), (unsigned)EventsOfType(events, EVENT_NEAR_COLLISION).size(),
+                    (unsigned)EventsOfType(events, EVENT_WALL_HIT).size(), (unsigned long long)events.total[EVENT_WAYPOINT_REACHED],
+                    (unsigned long long)events.total[EVENT_NEAR_COLLISION], (unsigned long long)events.total[EVENT_WALL_HIT]), 10, 166, 12, DARKGRAY);
+                for (const SimEvent& e : EventsOfType(events, EVENT_NEAR_COLLISION))
+                    if (e.agent < agents.size() && e.other < agents.size()) DrawLineEx(agents[e.agent].pos, agents[e.other].pos, 2.0f, RED);
+            }
+            if (settings.enableContacts)
+                DrawText(TextFormat("Contacts: %u, deepest overlap %.2f px, %.2f ms", contacts.contacts, contacts.maxOverlap, contacts.ms), 10, 96, 12, DARKGRAY);
         }
 
+        if (debugDraw && profileHz > 0) {
+            const Profiler& prof = SamplingProfiler();
+            DrawText(TextFormat("Profile: %llu samples", (unsigned long long)prof.samples), screenW - 520, 10, 12, DARKGRAY);
+            int y = 26;
+            for (const ProfileFunction* f : TopProfileFunctions(PROFILE_TOP)) {
+                DrawText(TextFormat("%5.1f%% %5.1f%%  %.60s", 100.0 * f->self / std::max<uint64_t>(prof.samples, 1),
+                    100.0 * f->total / std::max<uint64_t>(prof.samples, 1), f->name.c_str()), screenW - 520, y, 10, DARKGRAY);
+                y += 12;
+            }
+        }
+
+        if (shedder.level > LOAD_FULL)
+            DrawText(TextFormat("Overload level %d: %s  (step %.1f ms, budget %.1f ms)", shedder.level, LOAD_LEVEL_NAMES[shedder.level],
+                shedder.avgMs, shedder.budgetMs), 10, screenH - 28, 14, RED);
+
         // Legend/pause
         DrawText("Press ESC to exit.", screenW - 150, screenH - 28, 12, DARKGRAY);
 
         EndDrawing();
     }
 
+    finishReplay();
+    finishTrajectory();
+    if (!StopInputRecording(inputRecorder)) TraceLog(LOG_WARNING, "Input log %s: a write failed, the log is truncated", recordInputFile);
+    StopControlServer(control);
+    StopProfiler();
+    StateFeedDestroy(stateFeed);
     CloseWindow();
     return 0;
 }
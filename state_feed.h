@@ -0,0 +1,234 @@
+#pragma once
+// Live agent-state feed over shared memory.
+//
+// The simulation publishes one frame per step into a small ring of slots. Each slot is guarded by a
+// sequence counter (odd while being written), so the writer never waits on readers and readers never block
+// the writer. Readers get pointers straight into the shared slot (no copy) and re-check the counter
+// afterwards; a reader only loses a frame if it holds it longer than slotCount - 1 steps.
+//
+// Reader usage (no raylib needed):
+//   StateFeedReader feed;
+//   if (StateFeedOpen(feed, "steering_state")) {
+//       StateFeedView v;
+//       if (StateFeedLatest(feed, v)) {
+//           ... read v.posX[i], v.posY[i], v.velX[i], v.velY[i] for i < v.agentCount ...
+//           if (!StateFeedStillValid(v)) { /* overwritten while reading, discard */ }
+//       }
+//       StateFeedClose(feed);
+//   }
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char STATE_FEED_MAGIC[8] = { 'S','T','E','E','R','S','H','M' };
+static const uint32_t STATE_FEED_VERSION = 2;
+
+struct StateFeedHeader {
+    char magic[8];
+    std::atomic<uint32_t> version; // 0 until the writer has filled in the rest, then stored with release
+    uint32_t slotCount;
+    uint32_t maxAgents;     // per-slot capacity, larger populations are truncated
+    uint32_t slotBytes;     // stride between slots, slot 0 starts at headerBytes
+    uint32_t headerBytes;
+    uint32_t pad;
+    std::atomic<uint64_t> published; // frames published so far; newest is in slot (published - 1) % slotCount
+};
+
+// Slot layout: StateFeedSlot, then float posX[maxAgents], posY[..], velX[..], velY[..]
+struct StateFeedSlot {
+    std::atomic<uint32_t> seq;
+    uint32_t agentCount;    // agents in this frame (<= maxAgents)
+    uint32_t totalAgents;   // agents in the simulation, > agentCount when truncated
+    uint32_t pad;
+    uint64_t step;
+};
+
+struct StateFeedView {
+    const StateFeedSlot* slot = nullptr;
+    uint32_t seq = 0;
+    uint32_t agentCount = 0;
+    uint64_t step = 0;
+    const float* posX = nullptr;
+    const float* posY = nullptr;
+    const float* velX = nullptr;
+    const float* velY = nullptr;
+};
+
+// A named shared-memory mapping (POSIX shm object or Win32 named file mapping)
+struct SharedMapping {
+    void* base = nullptr;
+    size_t bytes = 0;
+    std::string name;
+    bool owner = false;
+#if defined(_WIN32)
+    HANDLE handle = nullptr;
+#endif
+};
+typedef SharedMapping StateFeedWriter;
+typedef SharedMapping StateFeedReader;
+
+inline void SharedMappingClose(SharedMapping& m) {
+    if (!m.base) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(m.base);
+    CloseHandle(m.handle);
+#else
+    munmap(m.base, m.bytes);
+    if (m.owner) shm_unlink(m.name.c_str());
+#endif
+    m = SharedMapping();
+}
+
+// Creates (or truncates) a zero-filled read/write mapping; the creator unlinks it again on close
+inline bool SharedMappingCreate(SharedMapping& m, const char* name, size_t bytes) {
+    m = SharedMapping();
+#if defined(_WIN32)
+    m.name = std::string("Local\\") + name;
+    m.handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, m.name.c_str());
+    if (!m.handle) return false;
+    m.base = MapViewOfFile(m.handle, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+    if (!m.base) { CloseHandle(m.handle); m = SharedMapping(); return false; }
+#else
+    m.name = std::string("/") + name;
+    int fd = shm_open(m.name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    void* p = ftruncate(fd, (off_t)bytes) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) { shm_unlink(m.name.c_str()); m = SharedMapping(); return false; }
+    m.base = p;
+#endif
+    m.bytes = bytes;
+    m.owner = true;
+    memset(m.base, 0, bytes);
+    return true;
+}
+
+inline bool SharedMappingOpen(SharedMapping& m, const char* name, bool writable) {
+    m = SharedMapping();
+#if defined(_WIN32)
+    DWORD access = writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ;
+    m.name = std::string("Local\\") + name;
+    m.handle = OpenFileMappingA(access, FALSE, m.name.c_str());
+    if (!m.handle) return false;
+    m.base = MapViewOfFile(m.handle, access, 0, 0, 0);
+    if (!m.base) { CloseHandle(m.handle); m = SharedMapping(); return false; }
+    MEMORY_BASIC_INFORMATION info;
+    m.bytes = VirtualQuery(m.base, &info, sizeof(info)) ? info.RegionSize : 0;
+#else
+    m.name = std::string("/") + name;
+    int fd = shm_open(m.name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void* p = (fstat(fd, &st) == 0 && st.st_size > 0)
+        ? mmap(nullptr, (size_t)st.st_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) { m = SharedMapping(); return false; }
+    m.base = p;
+    m.bytes = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+inline StateFeedHeader* StateFeedHeaderOf(const SharedMapping& m) { return (StateFeedHeader*)m.base; }
+
+inline StateFeedSlot* StateFeedSlotAt(const SharedMapping& m, uint64_t frame) {
+    const StateFeedHeader* h = StateFeedHeaderOf(m);
+    return (StateFeedSlot*)((char*)m.base + h->headerBytes + (size_t)(frame % h->slotCount) * h->slotBytes);
+}
+
+inline float* StateFeedColumn(StateFeedSlot* slot, uint32_t maxAgents, int column) {
+    return (float*)(slot + 1) + (size_t)column * maxAgents;
+}
+
+inline bool StateFeedCreate(StateFeedWriter& w, const char* name, uint32_t maxAgents, uint32_t slotCount = 4) {
+    if (slotCount < 2 || maxAgents == 0) return false;
+    uint32_t headerBytes = (uint32_t)((sizeof(StateFeedHeader) + 63) / 64 * 64);
+    uint64_t slotBytes = (sizeof(StateFeedSlot) + 4ull * sizeof(float) * maxAgents + 63) / 64 * 64;
+    if (slotBytes > 0xFFFFFFFFull) return false;
+    size_t bytes = headerBytes + (size_t)slotBytes * slotCount;
+    if (!SharedMappingCreate(w, name, bytes)) return false;
+    StateFeedHeader* h = new (w.base) StateFeedHeader();
+    memcpy(h->magic, STATE_FEED_MAGIC, sizeof(h->magic));
+    h->version.store(0, std::memory_order_relaxed);
+    h->slotCount = slotCount;
+    h->maxAgents = maxAgents;
+    h->slotBytes = (uint32_t)slotBytes;
+    h->headerBytes = headerBytes;
+    h->published.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < slotCount; ++i) new (StateFeedSlotAt(w, i)) StateFeedSlot();
+    // version last: a reader that loads it with acquire also sees the complete header and slots
+    h->version.store(STATE_FEED_VERSION, std::memory_order_release);
+    return true;
+}
+
+inline void StateFeedDestroy(StateFeedWriter& w) { SharedMappingClose(w); }
+
+// Writer side: returns the slot to fill for the next frame and marks it as being written
+inline StateFeedSlot* StateFeedBeginWrite(StateFeedWriter& w) {
+    StateFeedSlot* slot = StateFeedSlotAt(w, StateFeedHeaderOf(w)->published.load(std::memory_order_relaxed));
+    slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot;
+}
+
+inline void StateFeedEndWrite(StateFeedWriter& w, StateFeedSlot* slot) {
+    slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    StateFeedHeader* h = StateFeedHeaderOf(w);
+    h->published.store(h->published.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+inline bool StateFeedOpen(StateFeedReader& r, const char* name) {
+    if (!SharedMappingOpen(r, name, false)) return false;
+    const StateFeedHeader* h = StateFeedHeaderOf(r);
+    // the version is read first; only after it is seen are the other header fields valid to read
+    bool ok = r.bytes >= sizeof(StateFeedHeader) && h->version.load(std::memory_order_acquire) == STATE_FEED_VERSION
+        && memcmp(h->magic, STATE_FEED_MAGIC, sizeof(h->magic)) == 0 && h->slotCount >= 2
+        && h->headerBytes + (uint64_t)h->slotBytes * h->slotCount <= r.bytes;
+    if (!ok) SharedMappingClose(r);
+    return ok;
+}
+
+inline void StateFeedClose(StateFeedReader& r) { SharedMappingClose(r); }
+
+// Points `v` at the newest completely written frame; false if nothing has been published yet
+inline bool StateFeedLatest(const StateFeedReader& r, StateFeedView& v) {
+    const StateFeedHeader* h = StateFeedHeaderOf(r);
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        uint64_t published = h->published.load(std::memory_order_acquire);
+        if (published == 0) return false;
+        StateFeedSlot* slot = StateFeedSlotAt(r, published - 1);
+        uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq & 1) continue; // writer lapped us onto this slot, try the newer frame
+        v.slot = slot;
+        v.seq = seq;
+        v.agentCount = slot->agentCount < h->maxAgents ? slot->agentCount : h->maxAgents;
+        v.step = slot->step;
+        v.posX = StateFeedColumn(slot, h->maxAgents, 0);
+        v.posY = StateFeedColumn(slot, h->maxAgents, 1);
+        v.velX = StateFeedColumn(slot, h->maxAgents, 2);
+        v.velY = StateFeedColumn(slot, h->maxAgents, 3);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) == seq) return true;
+    }
+    return false;
+}
+
+// True if the frame behind `v` was not overwritten since StateFeedLatest; check after reading the data
+inline bool StateFeedStillValid(const StateFeedView& v) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return v.slot && v.slot->seq.load(std::memory_order_relaxed) == v.seq;
+}